@@ -181,6 +181,8 @@ void MainWindow::handleAboutAction()
 
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    renderManager->shutdown();
+
     nodeGraph->flushCacheAllNodes();
 
     vulkanView->getVulkanWindow()->getRenderer()->shutdown();
@@ -46,35 +46,33 @@ void applyColorToScanline(
         OCIO::ConstCPUProcessorRcPtr processor,
         float* pStart,
         int idx,
-        int lineWidth)
+        int lineWidth,
+        int numChannels)
 {
     OCIO::PackedImageDesc desc(
-                pStart + idx * lineWidth * 4,
+                pStart + size_t(idx) * lineWidth * numChannels,
                 lineWidth,
                 1,
-                4);
+                numChannels);
     processor->apply(desc);
 }
 
 void parallelApplyColorSpace(
-        OCIO::ConstConfigRcPtr ocioConfig,
-        const QString& sourceColor,
-        const QString& dstColor,
+        OCIO::ConstCPUProcessorRcPtr cpuProcessor,
         float* pStart,
         int width,
-        int height)
+        int height,
+        int numChannels = 4)
 {
-    OCIO::ConstProcessorRcPtr processor = ocioConfig->getProcessor(
-                sourceColor.toLocal8Bit(), dstColor.toLocal8Bit());
-
-    OCIO::ConstCPUProcessorRcPtr cpuProcessor = processor->getOptimizedCPUProcessor(OCIO::OPTIMIZATION_DEFAULT);
+    if (!cpuProcessor)
+        return;
 
     parallel_for(blocked_range<size_t>(0, height),
         [=](const tbb::blocked_range<size_t>& r)
     {
         for(size_t i = r.begin(); i!=r.end(); ++i)
 
-            applyColorToScanline(cpuProcessor, pStart, i, width);
+            applyColorToScanline(cpuProcessor, pStart, i, width, numChannels);
     });
 }
 
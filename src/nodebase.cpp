@@ -21,6 +21,7 @@
 #include "ui_nodebase.h"
 
 #include <math.h>
+#include <algorithm>
 
 #include <QPainter>
 #include <QMouseEvent>
@@ -39,6 +40,9 @@
 
 namespace Cascade {
 
+quint64 NodeBase::topologyVersion = 1;
+quint64 NodeBase::visitCounter = 0;
+
 NodeBase::NodeBase(
         const NodeType type,
         const NodeGraph* graph,
@@ -85,7 +89,30 @@ void NodeBase::setUpNode(
     this->createInputs(props);
     this->createOutputs(props);
 
-    nodeProperties = std::make_unique<NodeProperties>(nodeType, this, props);
+    // The property widgets are only built once they are needed
+    initProperties = props;
+}
+
+void NodeBase::createProperties()
+{
+    nodeProperties = std::make_unique<NodeProperties>(nodeType, this, initProperties);
+
+    if (!loadedPropertyValues.isEmpty())
+    {
+        // Loading values is no edit, nothing has to be rendered or saved
+        foreach (auto widget, nodeProperties->widgets)
+            widget->blockSignals(true);
+
+        nodeProperties->loadNodePropertyValues(loadedPropertyValues);
+
+        foreach (auto widget, nodeProperties->widgets)
+            widget->blockSignals(false);
+
+        loadedPropertyValues.clear();
+    }
+
+    // Entities showing the input size have missed all changes so far
+    emit inputSizeChanged();
 }
 
 void NodeBase::createInputs(const NodeInitProperties &props)
@@ -197,7 +224,10 @@ void NodeBase::setShaderCode(const std::vector<unsigned int> code)
 
 void NodeBase::loadNodePropertyValues(const QMap<int, QString> &values)
 {
-    nodeProperties->loadNodePropertyValues(values);
+    if (nodeProperties)
+        nodeProperties->loadNodePropertyValues(values);
+    else
+        loadedPropertyValues = values;
 }
 
 NodeInput* NodeBase::findNodeInput(const QString& id)
@@ -257,77 +287,89 @@ NodeBase* NodeBase::getUpstreamNodeFront() const
 
 void NodeBase::getAllUpstreamNodes(std::vector<NodeBase*>& nodes)
 {
+    if (upstreamOrderVersion != topologyVersion)
+    {
+        upstreamOrder.clear();
+
+        std::unordered_set<NodeBase*> visited;
+        visitUpstreamNodes(upstreamOrder, visited);
+
+        upstreamOrderVersion = topologyVersion;
+    }
+    nodes.insert(nodes.end(), upstreamOrder.begin(), upstreamOrder.end());
+}
+
+void NodeBase::visitUpstreamNodes(
+        std::vector<NodeBase*>& nodes,
+        std::unordered_set<NodeBase*>& visited)
+{
+    // A node reachable through several branches is only added once
+    if (!visited.insert(this).second)
+        return;
+
     if(auto n = getUpstreamNodeBack())
     {
-        n->getAllUpstreamNodes(nodes);
+        n->visitUpstreamNodes(nodes, visited);
     }
     if(auto n = getUpstreamNodeFront())
     {
-        n->getAllUpstreamNodes(nodes);
+        n->visitUpstreamNodes(nodes, visited);
     }
     nodes.push_back(this);
 }
 
-void NodeBase::requestUpdate()
+void NodeBase::invalidateTopology()
 {
-    if (nodeType == NODE_TYPE_CROP)
-    {
-        updateCropSizes();
-    }
-    else if (nodeType == NODE_TYPE_ROTATE)
-    {
-        updateRotation();
-    }
+    topologyVersion++;
+}
 
+void NodeBase::requestUpdate()
+{
     needsUpdate = true;
     invalidateAllDownstreamNodes();
 
+    // Downstream nodes are only marked, so an edit
+    // results in a single request to render
     emit nodeRequestUpdate(this);
 }
 
 QSize NodeBase::getInputSize() const
 {
-    auto upstreamNode = getUpstreamNodeBack();
+    return inputSize;
+}
 
-    QSize size(0, 0);
-    if (upstreamNode)
-    {
-        auto upstreamImage = upstreamNode->getCachedImage();
+void NodeBase::setInputSize(const QSize& size)
+{
+    if (inputSize == size)
+        return;
 
-        if (upstreamImage)
-        {
-            size.setWidth(upstreamImage->getWidth());
-            size.setHeight(upstreamImage->getHeight());
-        }
-    }
-    return size;
+    inputSize = size;
+
+    emit inputSizeChanged();
 }
 
-QSize NodeBase::getTargetSize() const
+QSize NodeBase::getTargetSize(const QSize& inputSize, const int renderScale) const
 {
-    QSize size(0, 0);
-    size = getInputSize();
+    QSize size = inputSize;
+
+    // Only the snapshot is read, this runs on the render thread
+    const auto& vals = parameterSnapshot.values;
 
-    if (nodeType == NODE_TYPE_CROP)
+    if (nodeType == NODE_TYPE_CROP && vals.size() > 3)
     {
-        // Crop
-        size.setWidth(size.width() - leftCrop - rightCrop);
-        size.setHeight(size.height() - topCrop - bottomCrop);
-        if(size.width() < 0)
+        // Each side is scaled as a float and truncated like the offsets in crop.comp
+        auto scaled = [renderScale](const float crop)
         {
-            size.setWidth(0);
-        }
-        if (size.height() < 0)
-        {
-            size.setHeight(0);
-        }
+            return static_cast<int>(crop / static_cast<float>(renderScale));
+        };
+        // Left, top, right and bottom, as in crop.comp
+        size.setWidth(std::max(size.width() - scaled(vals[0]) - scaled(vals[2]), 0));
+        size.setHeight(std::max(size.height() - scaled(vals[1]) - scaled(vals[3]), 0));
     }
-    if (nodeType == NODE_TYPE_RESIZE)
+    if (nodeType == NODE_TYPE_RESIZE && vals.size() > 1)
     {
-        // Resize
-        auto vals = getAllPropertyValues().split(",");
-        size.setWidth(vals[0].toInt());
-        size.setHeight(vals[1].toInt());
+        size.setWidth(std::max(static_cast<int>(vals[0]) / renderScale, 1));
+        size.setHeight(std::max(static_cast<int>(vals[1]) / renderScale, 1));
     }
     return size;
 }
@@ -336,11 +378,22 @@ void NodeBase::addNodeToJsonArray(QJsonArray& jsonNodesArray)
 {
     QJsonObject jsonProps;
 
-    auto widgets = getProperties()->widgets;
-
-    for(size_t i = 0; i < widgets.size(); i++)
+    if (!nodeProperties && !loadedPropertyValues.isEmpty())
     {
-        jsonProps.insert(QString::number(i), widgets[i]->getValuesAsString());
+        // Never opened since loading, the values are unchanged
+        for (auto it = loadedPropertyValues.cbegin(); it != loadedPropertyValues.cend(); ++it)
+        {
+            jsonProps.insert(QString::number(it.key()), it.value());
+        }
+    }
+    else
+    {
+        auto widgets = getProperties()->widgets;
+
+        for(size_t i = 0; i < widgets.size(); i++)
+        {
+            jsonProps.insert(QString::number(i), widgets[i]->getValuesAsString());
+        }
     }
 
     QJsonObject jsonInputs;
@@ -374,8 +427,15 @@ NodeInput* NodeBase::getOpenInput() const
 
 QString NodeBase::getAllPropertyValues() const
 {
+    // Never opened since loading, the values are unchanged
+    if (!nodeProperties)
+    {
+        QStringList loaded = loadedPropertyValues.values();
+        return loaded.join(",");
+    }
+
     QString vals;
-    auto widgets = getProperties()->widgets;
+    auto widgets = nodeProperties->widgets;
 
     for(size_t i = 0; i < widgets.size(); i++)
     {
@@ -389,13 +449,25 @@ QString NodeBase::getAllPropertyValues() const
 }
 
 void NodeBase::getAllDownstreamNodes(std::vector<NodeBase*>& nodes)
-{    
+{
+    visitDownstreamNodes(nodes, ++visitCounter);
+}
+
+void NodeBase::visitDownstreamNodes(std::vector<NodeBase*>& nodes, const quint64 stamp)
+{
     if(rgbaOut)
     {
         foreach(Connection* c, rgbaOut->getConnections())
         {
-            nodes.push_back(c->targetInput->parentNode);
-            c->targetInput->parentNode->getAllDownstreamNodes(nodes);
+            auto n = c->targetInput->parentNode;
+
+            // Reached through another branch already
+            if (n->visitStamp == stamp)
+                continue;
+            n->visitStamp = stamp;
+
+            nodes.push_back(n);
+            n->visitDownstreamNodes(nodes, stamp);
         }
     }
 }
@@ -428,12 +500,67 @@ CsImage* NodeBase::getCachedImage() const
 {
     if (cachedImage)
         return cachedImage.get();
+    // Read nodes at full resolution display their source directly
+    if (sourceImage)
+        return sourceImage.get();
+    return nullptr;
+}
+
+std::unique_ptr<CsImage> NodeBase::setCachedImage(std::unique_ptr<CsImage> image)
+{
+    std::swap(cachedImage, image);
+    return image;
+}
+
+CsImage* NodeBase::getSourceImage() const
+{
+    if (sourceImage)
+        return sourceImage.get();
     return nullptr;
 }
 
-void NodeBase::setCachedImage(std::unique_ptr<CsImage> image)
+std::unique_ptr<CsImage> NodeBase::setSourceImage(std::unique_ptr<CsImage> image)
+{
+    std::swap(sourceImage, image);
+    return image;
+}
+
+void NodeBase::takeParameterSnapshot()
+{
+    // Values of UI entities only change together with needsUpdate
+    // being set, either by the node itself or by an upstream node
+    if (needsUpdate || parameterSnapshot.version == 0)
+        updateParameterSnapshot();
+
+    shaderCodeSnapshot = shaderCode;
+}
+
+void NodeBase::updateParameterSnapshot()
 {
-    cachedImage = std::move(image);
+    auto parts = getAllPropertyValues().split(",");
+
+    parameterSnapshot.values.resize(parts.size());
+    parameterSnapshot.text.clear();
+
+    for (int i = 0; i < parts.size(); ++i)
+    {
+        bool isNumber = false;
+        parameterSnapshot.values[i] = parts[i].toFloat(&isNumber);
+
+        if (!isNumber && !parts[i].isEmpty())
+            parameterSnapshot.text.insert(i, parts[i]);
+    }
+    parameterSnapshot.version++;
+}
+
+const NodeParameters& NodeBase::getParameterSnapshot() const
+{
+    return parameterSnapshot;
+}
+
+const std::vector<unsigned int>& NodeBase::getShaderCodeSnapshot() const
+{
+    return shaderCodeSnapshot;
 }
 
 void NodeBase::invalidateAllDownstreamNodes()
@@ -442,8 +569,10 @@ void NodeBase::invalidateAllDownstreamNodes()
     getAllDownstreamNodes(nodes);
     foreach(auto& n, nodes)
     {
-        n->flushCache();
-        n->requestUpdate();
+        // Only mark the nodes as outdated, their images
+        // could still be in use by the render thread
+        n->needsUpdate = true;
+        emit n->nodeInvalidated();
     }
 }
 
@@ -462,6 +591,17 @@ void NodeBase::paintEvent(QPaintEvent *event)
         painter.fillPath(path, selectedColorBrush);
     }
 
+    if (decodeProgress >= 0.0f)
+    {
+        painter.setClipping(false);
+        painter.fillRect(
+                    QRectF(cornerRadius,
+                           height() - 5,
+                           (width() - 2 * cornerRadius) * decodeProgress,
+                           2),
+                    progressColorBrush);
+    }
+
     Q_UNUSED(event);
 }
 
@@ -503,8 +643,11 @@ bool NodeBase::canBeRendered() const
     return true;
 }
 
-NodeProperties* NodeBase::getProperties() const
+NodeProperties* NodeBase::getProperties()
 {
+    if (!nodeProperties)
+        createProperties();
+
     return nodeProperties.get();
 }
 
@@ -520,19 +663,13 @@ void NodeBase::updateConnectionPositions()
     }
 }
 
-void NodeBase::updateCropSizes()
+void NodeBase::setDecodeProgress(const float progress)
 {
-    auto vals = getAllPropertyValues().split(",");
-    leftCrop = vals[0].toInt();
-    topCrop = vals[1].toInt();
-    rightCrop = vals[2].toInt();
-    bottomCrop = vals[3].toInt();
-}
+    if (progress == decodeProgress)
+        return;
 
-void NodeBase::updateRotation()
-{
-    auto vals = getAllPropertyValues().split(",");
-    rotation = vals[0].toInt();
+    decodeProgress = progress;
+    this->update();
 }
 
 void NodeBase::mousePressEvent(QMouseEvent *event)
@@ -578,21 +715,34 @@ void NodeBase::mouseDoubleClickEvent(QMouseEvent *event)
 void NodeBase::flushCache()
 {
     cachedImage = nullptr;
+    sourceImage = nullptr;
+    cachedImageKey.clear();
+}
+
+size_t NodeBase::getCachedMemorySize() const
+{
+    size_t size = 0;
+    if (cachedImage)
+        size += cachedImage->getMemorySize();
+    if (sourceImage)
+        size += sourceImage->getMemorySize();
+
+    return size;
 }
 
 const int NodeBase::getNumImages()
 {
-    return nodeProperties->getNumImages();
+    return getProperties()->getNumImages();
 }
 
 void NodeBase::switchToFirstImage()
 {
-    nodeProperties->switchToFirstImage();
+    getProperties()->switchToFirstImage();
 }
 
 void NodeBase::switchToNextImage()
 {
-    nodeProperties->switchToNextImage();
+    getProperties()->switchToNextImage();
 }
 
 NodeBase::~NodeBase()
@@ -22,12 +22,14 @@
 
 #include <set>
 #include <memory>
+#include <unordered_set>
 
 #include <QPen>
 
 #include <gtest/gtest_prod.h>
 
 #include "nodedefinitions.h"
+#include "nodeparameters.h"
 #include "nodeproperties.h"
 #include "renderer/csimage.h"
 #include "windowmanager.h"
@@ -73,9 +75,12 @@ public:
 
     NodeInput* getNodeInputAtPosition(const QPoint pos);
 
-    NodeProperties* getProperties() const;
+    // Builds the property widgets the first time
+    NodeProperties* getProperties();
+    // Taken from the loaded values as long as no widgets were built
     QString getAllPropertyValues() const;
-    QSize getTargetSize() const;
+    // Computed from the parameter snapshot and the size of the back input
+    QSize getTargetSize(const QSize& inputSize, const int renderScale = 1) const;
     void addNodeToJsonArray(QJsonArray& jsonNodesArray);
 
     NodeInput* getRgbaBackIn() const;
@@ -85,11 +90,25 @@ public:
     NodeBase* getUpstreamNodeBack() const;
     NodeBase* getUpstreamNodeFront()const;
 
+    // Appends every upstream node once, inputs before the nodes using them
     void getAllUpstreamNodes(std::vector<NodeBase*>& nodes);
     std::set<Connection*> getAllConnections();
 
+    // Has to be called whenever a connection is made or removed
+    static void invalidateTopology();
+
+    // Both setters hand back the image they replaced
     CsImage* getCachedImage() const;
-    void setCachedImage(std::unique_ptr<CsImage> image);
+    std::unique_ptr<CsImage> setCachedImage(std::unique_ptr<CsImage> image);
+
+    CsImage* getSourceImage() const;
+    std::unique_ptr<CsImage> setSourceImage(std::unique_ptr<CsImage> image);
+
+    // The render thread only reads parameters through this snapshot,
+    // it is taken on the GUI thread when an evaluation starts
+    void takeParameterSnapshot();
+    const NodeParameters& getParameterSnapshot() const;
+    const std::vector<unsigned int>& getShaderCodeSnapshot() const;
 
     void invalidateAllDownstreamNodes();
 
@@ -98,7 +117,10 @@ public:
     void requestUpdate();
 
     NodeInput* getOpenInput() const;
+    // Full resolution size of the back input as of the
+    // last evaluation, no matter the scale it ran at
     QSize getInputSize() const;
+    void setInputSize(const QSize& size);
 
     QString getID() const;
     void setID(const QString& s);
@@ -114,7 +136,11 @@ public:
 
     void updateConnectionPositions();
 
+    // Shown while the file of a Read node is decoded, -1 hides it
+    void setDecodeProgress(const float progress);
+
     void flushCache();
+    size_t getCachedMemorySize() const;
 
     const int getNumImages();
     void switchToFirstImage();
@@ -124,19 +150,36 @@ public:
 
     bool needsUpdate = true;
 
+    // Render scale divisor the cached image was rendered with
+    int cachedImageScale = 1;
+    // Result cache key of the cached image
+    QByteArray cachedImageKey;
+    // Evaluation the node was last part of, least recently used
+    // nodes lose their images first when memory runs low
+    quint64 lastUsed = 0;
+    // Milliseconds it took to render this node and the nodes it was
+    // rendered from, decides whether evicted images are kept on the host
+    double renderCost = 0.0;
+
 private:
     FRIEND_TEST(NodeBaseTest, getAllDownstreamNodes_CorrectNumberOfNodes);
     FRIEND_TEST(NodeBaseTest, getAllDownstreamNodes_CorrectOrderOfNodes);
     FRIEND_TEST(NodeBaseTest, getAllUpstreamNodes_CorrectOrderOfNodes);
+    FRIEND_TEST(NodeBaseTest, invalidateAllDownstreamNodes_DeepGraphBenchmark);
 
     void setUpNode(const NodeType nodeType, const QString& cName = "");
+    void createProperties();
     void createInputs(const NodeInitProperties& props);
     void createOutputs(const NodeInitProperties& props);
 
+    // Every node is only added once, no matter through how many paths it is reached
     void getAllDownstreamNodes(std::vector<NodeBase*>& nodes);
+    void visitDownstreamNodes(std::vector<NodeBase*>& nodes, const quint64 stamp);
+    void visitUpstreamNodes(
+            std::vector<NodeBase*>& nodes,
+            std::unordered_set<NodeBase*>& visited);
 
-    void updateCropSizes();
-    void updateRotation();
+    void updateParameterSnapshot();
 
     void mousePressEvent(QMouseEvent*) override;
     void mouseMoveEvent(QMouseEvent*) override;
@@ -146,6 +189,9 @@ private:
     void moveEvent(QMoveEvent*) override;
 
     std::unique_ptr<CsImage> cachedImage;
+    // Full resolution decode of a Read node, proxies are derived from it
+    std::unique_ptr<CsImage> sourceImage;
+    QSize inputSize;
 
     Ui::NodeBase *ui;
     const NodeGraph* nodeGraph;
@@ -162,39 +208,52 @@ private:
     NodeInput* rgbaFrontIn = nullptr;
     NodeOutput* rgbaOut = nullptr;
 
+    NodeInitProperties initProperties;
     std::unique_ptr<NodeProperties> nodeProperties;
+    // Values of a loaded project, until the properties are built
+    QMap<int, QString> loadedPropertyValues;
 
     WindowManager* wManager;
 
     QString customName = "";
     std::vector<unsigned int> shaderCode;
 
+    NodeParameters parameterSnapshot;
+    std::vector<unsigned int> shaderCodeSnapshot;
+
+    // Evaluation order, only valid as long as no connection changed
+    std::vector<NodeBase*> upstreamOrder;
+    quint64 upstreamOrderVersion = 0;
+    static quint64 topologyVersion;
+
+    // Traversal the node was last reached by
+    quint64 visitStamp = 0;
+    static quint64 visitCounter;
+
     bool isSelected = false;
     bool isActive = false;
     bool isViewed = false;
     bool isDragging = false;
+    float decodeProgress = -1.0f;
 
     QPoint oldPos;
 
     bool hasCustomSize = false;
     UiEntity* sizeSource;
 
-    int leftCrop = 0;
-    int topCrop = 0;
-    int rightCrop = 0;
-    int bottomCrop = 0;
-
-    int rotation = 0;
-
     const int cornerRadius = 6;
     const QBrush defaultColorBrush = QBrush(QColor(0, 170, 255));
     const QBrush selectedColorBrush = QBrush(QColor(37, 74, 115));
     const QPen defaultColorPen = QPen(QColor(0x62, 0x69, 0x71), 3);
+    const QBrush progressColorBrush = QBrush(QColor(235, 235, 235));
 
 signals:
     void nodeWasLeftClicked(Cascade::NodeBase* node);
     void nodeWasDoubleClicked(Cascade::NodeBase* node);
     void nodeRequestUpdate(Cascade::NodeBase* node);
+    // An upstream node changed
+    void nodeInvalidated();
+    void inputSizeChanged();
     void nodeRequestFileSave(
             Cascade::NodeBase* node,
             const QString& path,
@@ -231,6 +231,26 @@ const static QMap<NodeType, QString> nodeStrings =
     { NODE_TYPE_WRITE, "Write Image" }
 };
 
+////////////////////////////////////
+// Parameters measured in pixels
+////////////////////////////////////
+// Indices into the values of getAllPropertyValues() that need
+// to be divided by the render scale when rendering a proxy
+const static QMap<NodeType, std::vector<int>> pixelParameters =
+{
+    { NODE_TYPE_BLOOM, { 0 } },
+    { NODE_TYPE_BLUR, { 4 } },
+    { NODE_TYPE_CHECKERBOARD, { 0 } },
+    { NODE_TYPE_CROP, { 0, 1, 2, 3 } },
+    { NODE_TYPE_DIRECTIONAL_BLUR, { 5 } },
+    { NODE_TYPE_ERODE, { 1 } },
+    { NODE_TYPE_MERGE, { 1, 2 } },
+    { NODE_TYPE_NOISE, { 1 } },
+    { NODE_TYPE_PIXELATE, { 0 } },
+    { NODE_TYPE_RESIZE, { 0, 1 } },
+    { NODE_TYPE_SMART_DENOISE, { 0 } }
+};
+
 ////////////////////////////////////
 // Struct to hold initialization values
 ////////////////////////////////////
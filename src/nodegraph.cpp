@@ -74,9 +74,12 @@ void NodeGraph::createNode(
         const QString& customName)
 {
     NodeBase* n = new NodeBase(type, this, nullptr, customName);
+    // A new node has no loaded values, its defaults come from the widgets
+    n->getProperties();
     scene->addWidget(n);
     n->move(pos);
     nodes.push_back(n);
+    nodeIndex.insert(n->getID(), n);
 
     connectNodeSignals(n);
 
@@ -91,10 +94,12 @@ void NodeGraph::createNode(
 NodeBase* NodeGraph::loadNode(const NodePersistentProperties& p)
 {
     NodeBase* n = new NodeBase(p.nodeType, this, nullptr, p.customName);
-    scene->addWidget(n);
+    // Placed before the proxy is created, so it enters the scene where it stays
     n->move(p.pos);
+    scene->addWidget(n);
     n->setID(p.uuid);
     nodes.push_back(n);
+    nodeIndex.insert(p.uuid, n);
 
     connectNodeSignals(n);
 
@@ -128,8 +133,17 @@ void NodeGraph::loadProject(const QJsonArray& jsonNodeGraph)
     QJsonObject jsonConnectionsHeading = jsonNodeGraph.at(1).toObject();
     QJsonArray jsonConnectionsArray = jsonConnectionsHeading.value("connections").toArray();
 
+    // Nothing has to be drawn or sorted into the scene index
+    // until the whole graph is in place
+    this->setUpdatesEnabled(false);
+    scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+
     this->clear();
 
+    nodes.reserve(jsonNodesArray.size());
+    nodeIndex.reserve(jsonNodesArray.size());
+    connections.reserve(jsonConnectionsArray.size());
+
     for (int i = 0; i < jsonNodesArray.size(); i++)
     {
         QJsonObject jsonNode = jsonNodesArray.at(i).toObject();
@@ -184,10 +198,17 @@ void NodeGraph::loadProject(const QJsonArray& jsonNodeGraph)
         if (!found)
             CS_LOG_WARNING("Could not load connection.");
     }
+
+    scene->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+    this->setUpdatesEnabled(true);
 }
 
 void NodeGraph::deleteNode(NodeBase *node)
 {
+    // The render thread might be using the node
+    rManager->waitForEvaluation();
+    rManager->cancelDecoding(node);
+
     node->invalidateAllDownstreamNodes();
 
     auto connections = node->getAllConnections();
@@ -197,6 +218,7 @@ void NodeGraph::deleteNode(NodeBase *node)
     }
 
     nodes.erase(remove(nodes.begin(), nodes.end(), node), nodes.end());
+    nodeIndex.remove(node->getID());
 
     scene->removeItem(node->graphicsProxyWidget());
 
@@ -264,12 +286,7 @@ void NodeGraph::activateNode(NodeBase *node)
 
 NodeBase* NodeGraph::findNode(const QString& id)
 {
-    foreach(NodeBase* n, nodes)
-    {
-        if (n->getID() == id)
-            return n;
-    }
-    return nullptr;
+    return nodeIndex.value(id, nullptr);
 }
 
 void NodeGraph::viewNode(NodeBase *node)
@@ -290,6 +307,11 @@ void NodeGraph::viewNode(NodeBase *node)
     }
 }
 
+const std::vector<NodeBase*>& NodeGraph::getNodes() const
+{
+    return nodes;
+}
+
 NodeBase* NodeGraph::getViewedNode()
 {
     return viewedNode;
@@ -325,6 +347,11 @@ void NodeGraph::handleNodeUpdateRequest(NodeBase* node)
     {
         emit requestNodeDisplay(node);
     }
+    // Nodes below the edited one don't send requests of their own
+    else if (viewedNode && viewedNode->needsUpdate)
+    {
+        emit requestNodeDisplay(viewedNode);
+    }
 }
 
 void NodeGraph::handleFileSaveRequest(
@@ -535,20 +562,47 @@ void NodeGraph::getNodeGraphAsJson(QJsonArray& jsonNodeGraph)
 
 void NodeGraph::flushCacheAllNodes()
 {
+    rManager->waitForEvaluation();
+
     for (auto& n : nodes)
         n->flushCache();
 }
 
 void NodeGraph::clear()
 {
+    // The render thread might be using the nodes
+    rManager->waitForEvaluation();
+
+    // Everything goes, so nothing downstream has to be invalidated
     foreach (const auto& connection, connections)
     {
-        this->deleteConnection(connection);
+        connection->sourceOutput->removeConnection(connection);
+        connection->targetInput->removeInConnectionNoUpdate();
+        scene->removeItem(connection);
+        delete connection;
     }
+    connections.clear();
+    NodeBase::invalidateTopology();
+
+    if (viewedNode)
+        emit requestClearScreen();
+    if (activeNode)
+        emit requestClearProperties();
+
+    viewedNode = nullptr;
+    activeNode = nullptr;
+    selectedNode = nullptr;
+
     foreach (const auto& node, nodes)
     {
-        this->deleteNode(node);
+        rManager->cancelDecoding(node);
+        scene->removeItem(node->graphicsProxyWidget());
+        delete node;
     }
+    nodes.clear();
+    nodeIndex.clear();
+
+    emit projectIsDirty();
 }
 
 void NodeGraph::mousePressEvent(QMouseEvent* event)
@@ -22,6 +22,7 @@
 
 #include <set>
 
+#include <QHash>
 #include <QObject>
 #include <QGraphicsView>
 
@@ -49,6 +50,7 @@ class NodeGraph : public QGraphicsView
     Q_OBJECT
 
 friend class NodeBaseTest;
+friend class NodeGraphTest;
 
 public:
     NodeGraph(QWidget* parent = nullptr);
@@ -62,6 +64,7 @@ public:
 
     NodeBase* getViewedNode();
     NodeBase* getSelectedNode();
+    const std::vector<NodeBase*>& getNodes() const;
 
     float getViewScale() const;
 
@@ -108,6 +111,8 @@ private:
     NodeGraphContextMenu* contextMenu;
 
     std::vector<NodeBase*> nodes;
+    // Nodes by their ID, to resolve the connections of a project
+    QHash<QString, NodeBase*> nodeIndex;
     std::vector<Connection*> connections;
 
     bool leftMouseIsDragging = false;
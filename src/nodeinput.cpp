@@ -73,6 +73,7 @@ void NodeInput::updateConnection()
 void NodeInput::addInConnection(Connection* c)
 {
     inConnection = c;
+    NodeBase::invalidateTopology();
     updateConnection();
     parentNode->requestUpdate();
 }
@@ -80,15 +81,23 @@ void NodeInput::addInConnection(Connection* c)
 void NodeInput::addInConnectionNoUpdate(Connection* c)
 {
     inConnection = c;
+    NodeBase::invalidateTopology();
     updateConnection();
 }
 
 void NodeInput::removeInConnection()
 {
     inConnection = nullptr;
+    NodeBase::invalidateTopology();
     parentNode->requestUpdate();
 }
 
+void NodeInput::removeInConnectionNoUpdate()
+{
+    inConnection = nullptr;
+    NodeBase::invalidateTopology();
+}
+
 QString NodeInput::getID() const
 {
     return id;
@@ -38,6 +38,7 @@ public:
     void addInConnection(Connection*);
     void addInConnectionNoUpdate(Connection*);
     void removeInConnection();
+    void removeInConnectionNoUpdate();
     void updateConnection();
     bool hasConnection();
 
@@ -0,0 +1,44 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NODEPARAMETERS_H
+#define NODEPARAMETERS_H
+
+#include <vector>
+
+#include <QHash>
+#include <QString>
+
+namespace Cascade {
+
+// The values of all UI entities of a node, in the order the
+// shaders read them. Parsed once whenever they change, so they
+// can be copied straight into a settings buffer.
+struct NodeParameters
+{
+    std::vector<float> values;
+    // Values that are no numbers, like file paths, by index
+    QHash<int, QString> text;
+    // Increases with every change of the values
+    quint64 version = 0;
+};
+
+} // namespace Cascade
+
+#endif // NODEPARAMETERS_H
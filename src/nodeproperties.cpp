@@ -278,6 +278,8 @@ NodeProperties::NodeProperties(
 
             connect(parentNode, &NodeBase::nodeRequestUpdate,
                     item, &ResizePropertiesEntity::handleNodeRequestUpdate);
+            connect(parentNode, &NodeBase::inputSizeChanged,
+                    item, &ResizePropertiesEntity::handleNodeRequestUpdate);
         }
         else if (elem.first == UI_ELEMENT_TYPE_CODE_EDITOR)
         {
@@ -19,6 +19,8 @@
 
 #include "preferencesmanager.h"
 
+#include <algorithm>
+
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -82,3 +84,69 @@ const QJsonArray& PreferencesManager::getKeys()
 {
     return jsonKeysPrefsArray;
 }
+
+QJsonValue PreferencesManager::getGeneralPreference(const QString& setting) const
+{
+    for (const auto& pref : jsonGeneralPrefsArray)
+    {
+        QJsonObject jsonPref = pref.toObject();
+        if (jsonPref["setting"].toString() == setting)
+            return jsonPref["value"];
+    }
+    return QJsonValue();
+}
+
+int PreferencesManager::getGpuMemoryBudget() const
+{
+    return std::max(getGeneralPreference("GPU Memory Budget (MB)").toInt(), 0);
+}
+
+int PreferencesManager::getHostSpillBudget() const
+{
+    auto value = getGeneralPreference("Host Spill Budget (MB)");
+    if (value.isUndefined())
+        return 4096;
+
+    return std::max(value.toInt(), 0);
+}
+
+QString PreferencesManager::getSpillDirectory() const
+{
+    return getGeneralPreference("Spill Directory").toString();
+}
+
+int PreferencesManager::getSpillDiskBudget() const
+{
+    auto value = getGeneralPreference("Spill Disk Budget (MB)");
+    if (value.isUndefined())
+        return 8192;
+
+    return std::max(value.toInt(), 0);
+}
+
+int PreferencesManager::getImageCacheSize() const
+{
+    auto value = getGeneralPreference("Image Cache Size (MB)");
+    if (value.isUndefined())
+        return 1024;
+
+    return std::max(value.toInt(), 1);
+}
+
+int PreferencesManager::getPrefetchBudget() const
+{
+    auto value = getGeneralPreference("Prefetch Budget (MB)");
+    if (value.isUndefined())
+        return 2048;
+
+    return std::max(value.toInt(), 0);
+}
+
+int PreferencesManager::getDecodedImageCacheSize() const
+{
+    auto value = getGeneralPreference("Decoded Image Cache (MB)");
+    if (value.isUndefined())
+        return 2048;
+
+    return std::max(value.toInt(), 0);
+}
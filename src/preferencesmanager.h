@@ -36,9 +36,26 @@ public:
 
     const QJsonArray& getKeys();
 
+    // In MB, 0 means the budget reported by the device is used
+    int getGpuMemoryBudget() const;
+    // In MB, 0 disables keeping evicted images in host memory
+    int getHostSpillBudget() const;
+    // Empty disables spilling evicted images to disk
+    QString getSpillDirectory() const;
+    // In MB, the oldest spilled files are deleted beyond it
+    int getSpillDiskBudget() const;
+    // In MB, files that would need more host memory are streamed
+    int getImageCacheSize() const;
+    // In MB, 0 disables decoding files ahead of a batch render
+    int getPrefetchBudget() const;
+    // In MB, 0 decodes every file again when a Read node switches to it
+    int getDecodedImageCacheSize() const;
+
 private:
     PreferencesManager() {}
 
+    QJsonValue getGeneralPreference(const QString& setting) const;
+
     void loadPreferences();
 
     QJsonArray jsonGeneralPrefsArray;
@@ -0,0 +1,130 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "colorprocessorcache.h"
+
+#include <chrono>
+
+#include "renderconfig.h"
+#include "../log.h"
+
+namespace Cascade::Renderer {
+
+void ColorProcessorCache::setConfig(OCIO::ConstConfigRcPtr ocioConfig)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    config = ocioConfig;
+    configID = config ? config->getCacheID() : std::string();
+    processors.clear();
+}
+
+void ColorProcessorCache::warmUp()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& colorSpace : colorSpaces)
+    {
+        getProcessor(colorSpace.second, "linear");
+        getProcessor("linear", colorSpace.second);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+
+    CS_LOG_INFO("Color processors created in " + QString::number(duration.count()) + "[milliseconds]");
+}
+
+OCIO::ConstCPUProcessorRcPtr ColorProcessorCache::getProcessor(
+        const QString& from,
+        const QString& to,
+        const OCIO::OptimizationFlags optimization)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto key = std::make_tuple(configID, from, to, static_cast<int>(optimization));
+
+    auto it = processors.find(key);
+    if (it != processors.end())
+    {
+        hits++;
+        return it->second;
+    }
+    misses++;
+
+    // Failures are remembered too
+    auto processor = createProcessor(from, to, optimization);
+    processors[key] = processor;
+
+    return processor;
+}
+
+OCIO::ConstCPUProcessorRcPtr ColorProcessorCache::createProcessor(
+        const QString& from,
+        const QString& to,
+        const OCIO::OptimizationFlags optimization)
+{
+    if (!config)
+        return nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+
+    OCIO::ConstCPUProcessorRcPtr processor;
+    try
+    {
+        processor = config->getProcessor(from.toLocal8Bit(), to.toLocal8Bit())
+                ->getOptimizedCPUProcessor(optimization);
+    }
+    catch (OCIO::Exception& exception)
+    {
+        CS_LOG_WARNING("OpenColorIO Error: " + QString(exception.what()));
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+    buildMilliseconds += ms;
+
+    CS_LOG_INFO("Color processor " + from + " to " + to + " " +
+                QString::number(ms, 'f', 2) + "[milliseconds]");
+
+    return processor;
+}
+
+int ColorProcessorCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return hits;
+}
+
+int ColorProcessorCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return misses;
+}
+
+double ColorProcessorCache::getBuildMilliseconds() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return buildMilliseconds;
+}
+
+} // namespace Cascade::Renderer
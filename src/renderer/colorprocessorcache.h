@@ -0,0 +1,79 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLORPROCESSORCACHE_H
+#define COLORPROCESSORCACHE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include <QString>
+
+#include <OpenColorIO/OpenColorIO.h>
+
+namespace OCIO = OCIO_NAMESPACE;
+
+namespace Cascade::Renderer {
+
+// Optimized OCIO CPU processors, so the LUT chains of a color space
+// are not put together again for every image that is loaded or saved.
+// Processors can be used from any thread.
+class ColorProcessorCache
+{
+public:
+    void setConfig(OCIO::ConstConfigRcPtr ocioConfig);
+
+    // Creates the processors to and from linear for all colorSpaces
+    void warmUp();
+
+    // Null if the config has no conversion between the two
+    OCIO::ConstCPUProcessorRcPtr getProcessor(
+            const QString& from,
+            const QString& to,
+            const OCIO::OptimizationFlags optimization = OCIO::OPTIMIZATION_DEFAULT);
+
+    int getHits() const;
+    int getMisses() const;
+    // Time spent creating processors
+    double getBuildMilliseconds() const;
+
+private:
+    OCIO::ConstCPUProcessorRcPtr createProcessor(
+            const QString& from,
+            const QString& to,
+            const OCIO::OptimizationFlags optimization);
+
+    OCIO::ConstConfigRcPtr config;
+    std::string configID;
+
+    // Config, source, destination and optimization level
+    std::map<std::tuple<std::string, QString, QString, int>, OCIO::ConstCPUProcessorRcPtr> processors;
+
+    int hits = 0;
+    int misses = 0;
+    double buildMilliseconds = 0.0;
+
+    mutable std::mutex mutex;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // COLORPROCESSORCACHE_H
@@ -0,0 +1,186 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "colortransformshaders.h"
+
+#include <QRegularExpression>
+
+#include "../log.h"
+#include "../shadercompiler/SpvShaderCompiler.h"
+
+namespace Cascade::Renderer {
+
+// Stands in for texture() on the table, which is bound
+// as a storage image like every other image of a dispatch
+static const QString linearSampling =
+        "vec4 ocioSample2D(vec2 coords)\n"
+        "{\n"
+        "    ivec2 size = imageSize(ocioLut);\n"
+        "    vec2 p = coords * vec2(size) - 0.5;\n"
+        "    ivec2 i = ivec2(floor(p));\n"
+        "    vec2 f = p - vec2(i);\n"
+        "    ivec2 maxCoords = size - 1;\n"
+        "    vec4 a = imageLoad(ocioLut, clamp(i, ivec2(0), maxCoords));\n"
+        "    vec4 b = imageLoad(ocioLut, clamp(i + ivec2(1, 0), ivec2(0), maxCoords));\n"
+        "    vec4 c = imageLoad(ocioLut, clamp(i + ivec2(0, 1), ivec2(0), maxCoords));\n"
+        "    vec4 d = imageLoad(ocioLut, clamp(i + ivec2(1, 1), ivec2(0), maxCoords));\n"
+        "    return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);\n"
+        "}\n\n";
+
+static const QString nearestSampling =
+        "vec4 ocioSample2D(vec2 coords)\n"
+        "{\n"
+        "    ivec2 size = imageSize(ocioLut);\n"
+        "    return imageLoad(ocioLut, clamp(ivec2(floor(coords * vec2(size))), ivec2(0), size - 1));\n"
+        "}\n\n";
+
+void ColorTransformShaders::setConfig(OCIO::ConstConfigRcPtr ocioConfig)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    config = ocioConfig;
+    shaders.clear();
+}
+
+const ColorTransformShaders::Shader* ColorTransformShaders::getShader(const QString& from, const QString& to)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto key = std::make_pair(from, to);
+
+    auto it = shaders.find(key);
+    if (it == shaders.end())
+        it = shaders.emplace(key, createShader(from, to)).first;
+
+    return it->second.get();
+}
+
+std::unique_ptr<ColorTransformShaders::Shader> ColorTransformShaders::createShader(
+        const QString& from,
+        const QString& to) const
+{
+    if (!config)
+        return nullptr;
+
+    auto shader = std::make_unique<Shader>();
+    QString ocioCode;
+    OCIO::Interpolation interpolation = OCIO::INTERP_LINEAR;
+
+    try
+    {
+        auto processor = config->getProcessor(from.toLocal8Bit(), to.toLocal8Bit());
+
+        auto desc = OCIO::GpuShaderDesc::CreateShaderDesc();
+        desc->setLanguage(OCIO::GPU_LANGUAGE_GLSL_4_0);
+        desc->setFunctionName("ocioTransform");
+        processor->getDefaultGPUProcessor()->extractGpuShaderInfo(desc);
+
+        if (desc->getNumUniforms() > 0 || desc->getNum3DTextures() > 0 || desc->getNumTextures() > 1)
+            return nullptr;
+
+        if (desc->getNumTextures() == 1)
+        {
+            const char* textureName = nullptr;
+            const char* samplerName = nullptr;
+            unsigned width = 0;
+            unsigned height = 0;
+            OCIO::GpuShaderDesc::TextureType channel;
+#if OCIO_VERSION_HEX >= 0x02030000
+            OCIO::GpuShaderDesc::TextureDimensions dimensions;
+            desc->getTexture(0, textureName, samplerName, width, height, channel, dimensions, interpolation);
+#else
+            desc->getTexture(0, textureName, samplerName, width, height, channel, interpolation);
+#endif
+            const float* values = nullptr;
+            desc->getTextureValues(0, values);
+
+            const bool isRed = channel == OCIO::GpuShaderDesc::TEXTURE_RED_CHANNEL;
+
+            shader->lutWidth = static_cast<int>(width);
+            shader->lutHeight = static_cast<int>(height);
+            shader->lut.resize(size_t(width) * height * 4);
+            for (size_t i = 0; i < size_t(width) * height; ++i)
+            {
+                for (size_t c = 0; c < 3; ++c)
+                    shader->lut[i * 4 + c] = isRed ? values[i] : values[i * 3 + c];
+                shader->lut[i * 4 + 3] = 1.0f;
+            }
+        }
+
+        ocioCode = QString::fromUtf8(desc->getShaderText());
+    }
+    catch (OCIO::Exception& exception)
+    {
+        CS_LOG_WARNING("OpenColorIO Error: " + QString(exception.what()));
+        return nullptr;
+    }
+
+    ocioCode.remove(QRegularExpression("/\\*.*?\\*/", QRegularExpression::DotMatchesEverythingOption));
+    ocioCode.remove(QRegularExpression("//[^\n]*"));
+
+    // The table is read through ocioSample1D() or ocioSample2D() instead of a sampler
+    QRegularExpression samplerExpr("uniform\\s+sampler([12])D\\s+(\\w+)\\s*;");
+    auto samplerMatch = samplerExpr.match(ocioCode);
+    if (samplerMatch.hasMatch())
+    {
+        QRegularExpression textureExpr(
+                    "\\btexture\\s*\\(\\s*" + samplerMatch.captured(2) + "\\s*,");
+
+        ocioCode.remove(samplerMatch.capturedStart(), samplerMatch.capturedLength());
+        ocioCode.replace(textureExpr, samplerMatch.captured(1) == "1" ? "ocioSample1D(" : "ocioSample2D(");
+    }
+
+    if (ocioCode.contains(QRegularExpression("\\b(uniform|texture\\w*)\\b")))
+    {
+        CS_LOG_WARNING("Color transform from " + from + " to " + to + " stays on the CPU.");
+        return nullptr;
+    }
+
+    QString code =
+            "#version 430\n\n"
+            "layout (local_size_x = 16, local_size_y = 16) in;\n"
+            "layout (binding = 0, rgba32f) uniform readonly image2D inputImage;\n"
+            "layout (binding = 1, rgba32f) uniform readonly image2D ocioLut;\n"
+            "layout (binding = 2, rgba32f) uniform image2D resultImage;\n\n";
+
+    code += interpolation == OCIO::INTERP_NEAREST ? nearestSampling : linearSampling;
+    code += "vec4 ocioSample1D(float coord)\n"
+            "{\n"
+            "    return ocioSample2D(vec2(coord, 0.5));\n"
+            "}\n\n";
+    code += ocioCode;
+    code += "\nvoid main()\n"
+            "{\n"
+            "    ivec2 pixelCoords = ivec2(gl_GlobalInvocationID.xy);\n\n"
+            "    imageStore(resultImage, pixelCoords, ocioTransform(imageLoad(inputImage, pixelCoords)));\n"
+            "}\n";
+
+    SpvCompiler compiler;
+    if (!compiler.compileGLSLFromCode(code.toStdString(), "comp"))
+    {
+        CS_LOG_WARNING("Compilation of color transform shader failed:");
+        CS_LOG_WARNING(QString::fromStdString(compiler.getError()));
+        return nullptr;
+    }
+    shader->code = compiler.getSpirV();
+
+    return shader;
+}
+
+} // namespace Cascade::Renderer
@@ -0,0 +1,70 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLORTRANSFORMSHADERS_H
+#define COLORTRANSFORMSHADERS_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QString>
+
+#include <OpenColorIO/OpenColorIO.h>
+
+namespace OCIO = OCIO_NAMESPACE;
+
+namespace Cascade::Renderer {
+
+// OCIO color space conversions as compute shaders, so images can be
+// converted on the device while they are uploaded or read back.
+// Conversions that need uniforms, a 3D LUT or more than one lookup
+// table are left to the CPU.
+class ColorTransformShaders
+{
+public:
+    struct Shader
+    {
+        std::vector<unsigned int> code;
+        // RGBA, bound as the second image. Empty if there is no table.
+        std::vector<float> lut;
+        int lutWidth = 0;
+        int lutHeight = 0;
+    };
+
+    void setConfig(OCIO::ConstConfigRcPtr ocioConfig);
+
+    // Null if the conversion has to run on the CPU. The shader is
+    // compiled the first time a pair is asked for, from any thread.
+    const Shader* getShader(const QString& from, const QString& to);
+
+private:
+    std::unique_ptr<Shader> createShader(const QString& from, const QString& to) const;
+
+    OCIO::ConstConfigRcPtr config;
+
+    // Failed pairs are remembered as null
+    std::map<std::pair<QString, QString>, std::unique_ptr<Shader>> shaders;
+    std::mutex mutex;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // COLORTRANSFORMSHADERS_H
@@ -28,11 +28,13 @@ CsCommandBuffer::CsCommandBuffer(
         const vk::Device* d,
         const vk::PhysicalDevice* pd,
         vk::PipelineLayout* pipelineLayout,
-        vk::DescriptorSet* descriptorSet) :
+        vk::DescriptorSet* descriptorSet,
+        CsSettingsBuffer* settings) :
     device(d),
     physicalDevice(pd),
     computePipelineLayout(pipelineLayout),
-    computeDescriptorSet(descriptorSet)
+    computeDescriptorSet(descriptorSet),
+    settingsBuffer(settings)
 {
     createComputeQueue();
     createComputeCommandPool();
@@ -54,8 +56,13 @@ void CsCommandBuffer::createComputeQueue()
         }
     }
 
+    // The window asks for a second queue in this family if there is one,
+    // so the render thread does not submit to the queue of the viewer
+    uint32_t queueIndex = queueFamilyProperties[computeFamilyIndex].queueCount > 1 ? 1 : 0;
+    dedicatedQueue = queueIndex == 1;
+
     // Get a compute queue from the device
-    computeQueue = device->getQueue(computeFamilyIndex, 0);
+    computeQueue = device->getQueue(computeFamilyIndex, queueIndex);
 }
 
 void CsCommandBuffer::createComputeCommandPool()
@@ -123,12 +130,14 @@ void CsCommandBuffer::recordGeneric(
     commandBufferGeneric->bindPipeline(
                 vk::PipelineBindPoint::eCompute,
                 pl);
+    // The settings of this dispatch
+    uint32_t settingsOffset = settingsBuffer->getOffset();
     commandBufferGeneric->bindDescriptorSets(
                 vk::PipelineBindPoint::eCompute,
                 *computePipelineLayout,
                 0,
                 *computeDescriptorSet,
-                {});
+                settingsOffset);
     commandBufferGeneric->dispatch(
                 outputImage->getWidth() / 16 + 1,
                 outputImage->getHeight() / 16 + 1,
@@ -170,30 +179,33 @@ void CsCommandBuffer::recordImageLoad(
 
     result = commandBufferImageLoad->begin(cmdBufferBeginInfo);
 
-    loadImage->transitionLayoutTo(
-                commandBufferImageLoad,
-                vk::ImageLayout::eTransferSrcOptimal);
-
-    tmpImage->transitionLayoutTo(
-                commandBufferImageLoad,
-                vk::ImageLayout::eTransferDstOptimal);
-
-    vk::ImageCopy copyInfo;
-    copyInfo.srcSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
-    copyInfo.srcSubresource.layerCount  = 1;
-    copyInfo.dstSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
-    copyInfo.dstSubresource.layerCount  = 1;
-    copyInfo.extent.width               = loadImage->getWidth();
-    copyInfo.extent.height              = loadImage->getHeight();
-    copyInfo.extent.depth               = 1;
-
-    commandBufferImageLoad->copyImage(
-                *loadImage->getImage(),
-                vk::ImageLayout::eTransferSrcOptimal,
-                *tmpImage->getImage(),
-                vk::ImageLayout::eTransferDstOptimal,
-                1,
-                &copyInfo);
+    if (loadImage)
+    {
+        loadImage->transitionLayoutTo(
+                    commandBufferImageLoad,
+                    vk::ImageLayout::eTransferSrcOptimal);
+
+        tmpImage->transitionLayoutTo(
+                    commandBufferImageLoad,
+                    vk::ImageLayout::eTransferDstOptimal);
+
+        vk::ImageCopy copyInfo;
+        copyInfo.srcSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
+        copyInfo.srcSubresource.layerCount  = 1;
+        copyInfo.dstSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
+        copyInfo.dstSubresource.layerCount  = 1;
+        copyInfo.extent.width               = loadImage->getWidth();
+        copyInfo.extent.height              = loadImage->getHeight();
+        copyInfo.extent.depth               = 1;
+
+        commandBufferImageLoad->copyImage(
+                    *loadImage->getImage(),
+                    vk::ImageLayout::eTransferSrcOptimal,
+                    *tmpImage->getImage(),
+                    vk::ImageLayout::eTransferDstOptimal,
+                    1,
+                    &copyInfo);
+    }
 
     tmpImage->transitionLayoutTo(
                 commandBufferImageLoad,
@@ -206,15 +218,17 @@ void CsCommandBuffer::recordImageLoad(
     commandBufferImageLoad->bindPipeline(
                 vk::PipelineBindPoint::eCompute,
                 *readNodePipeline);
+    // The settings of this dispatch
+    uint32_t settingsOffset = settingsBuffer->getOffset();
     commandBufferImageLoad->bindDescriptorSets(
                 vk::PipelineBindPoint::eCompute,
                 *computePipelineLayout,
                 0,
                 *computeDescriptorSet,
-                {});
+                settingsOffset);
     commandBufferImageLoad->dispatch(
-                loadImage->getWidth() / 16 + 1,
-                loadImage->getHeight() / 16 + 1,
+                tmpImage->getWidth() / 16 + 1,
+                tmpImage->getHeight() / 16 + 1,
                 1);
 
     renderTarget->transitionLayoutTo(
@@ -224,7 +238,54 @@ void CsCommandBuffer::recordImageLoad(
     result = commandBufferImageLoad->end();
 }
 
-vk::DeviceMemory* CsCommandBuffer::recordImageSave(
+void CsCommandBuffer::recordImageBandLoad(
+        CsImage* const bandImage,
+        CsImage* const tmpImage,
+        const int offsetY,
+        const int rows)
+{
+    auto result = computeQueue.waitIdle();
+
+    vk::CommandBufferBeginInfo cmdBufferBeginInfo;
+
+    result = commandBufferImageLoad->begin(cmdBufferBeginInfo);
+
+    bandImage->transitionLayoutTo(
+                commandBufferImageLoad,
+                vk::ImageLayout::eTransferSrcOptimal);
+
+    tmpImage->transitionLayoutTo(
+                commandBufferImageLoad,
+                vk::ImageLayout::eTransferDstOptimal);
+
+    vk::ImageCopy copyInfo;
+    copyInfo.srcSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
+    copyInfo.srcSubresource.layerCount  = 1;
+    copyInfo.dstSubresource.aspectMask  = vk::ImageAspectFlagBits::eColor;
+    copyInfo.dstSubresource.layerCount  = 1;
+    copyInfo.dstOffset.y                = offsetY;
+    copyInfo.extent.width               = bandImage->getWidth();
+    copyInfo.extent.height              = rows;
+    copyInfo.extent.depth               = 1;
+
+    commandBufferImageLoad->copyImage(
+                *bandImage->getImage(),
+                vk::ImageLayout::eTransferSrcOptimal,
+                *tmpImage->getImage(),
+                vk::ImageLayout::eTransferDstOptimal,
+                1,
+                &copyInfo);
+
+    // The host writes the next band into it
+    bandImage->transitionLayoutTo(
+                commandBufferImageLoad,
+                vk::ImageLayout::eGeneral);
+
+    result = commandBufferImageLoad->end();
+    Q_UNUSED(result);
+}
+
+float* CsCommandBuffer::recordImageSave(
         CsImage *const inputImage)
 {
     CS_LOG_INFO("Copying image GPU-->CPU.");
@@ -238,9 +299,21 @@ vk::DeviceMemory* CsCommandBuffer::recordImageSave(
 
     auto outputImageSize = QSize(inputImage->getWidth(), inputImage->getHeight());
 
-    vk::DeviceSize bufferSize = outputImageSize.width() * outputImageSize.height() * 16; // 4 channels * 4 bytes
+    vk::DeviceSize bufferSize = vk::DeviceSize(outputImageSize.width()) * outputImageSize.height() * 16; // 4 channels * 4 bytes
 
-    createBuffer(outputStagingBuffer, outputStagingBufferMemory, bufferSize);
+    // Reused as long as the images fit, batches save frames of the same size
+    if (bufferSize > outputStagingBufferSize)
+    {
+        releaseImageSave();
+
+        if (!createBuffer(outputStagingBuffer, outputStagingBufferMemory, bufferSize))
+        {
+            CS_LOG_WARNING("Could not create the output staging buffer.");
+            result = commandBufferImageSave->end();
+            return nullptr;
+        }
+        outputStagingBufferSize = bufferSize;
+    }
 
     inputImage->transitionLayoutTo(
                 commandBufferImageSave,
@@ -276,7 +349,18 @@ vk::DeviceMemory* CsCommandBuffer::recordImageSave(
     result = commandBufferImageSave->end();
     Q_UNUSED(result);
 
-    return &outputStagingBufferMemory.get();
+    return pOutputStaging;
+}
+
+void CsCommandBuffer::releaseImageSave()
+{
+    if (pOutputStaging)
+        device->unmapMemory(*outputStagingBufferMemory);
+
+    pOutputStaging = nullptr;
+    outputStagingBuffer = {};
+    outputStagingBufferMemory = {};
+    outputStagingBufferSize = 0;
 }
 
 void CsCommandBuffer::submitGeneric()
@@ -369,12 +453,17 @@ vk::CommandBuffer* CsCommandBuffer::getImageLoad()
     return &(*commandBufferImageLoad);
 }
 
+bool CsCommandBuffer::hasDedicatedQueue() const
+{
+    return dedicatedQueue;
+}
+
 vk::CommandBuffer* CsCommandBuffer::getImageSave()
 {
     return &(*commandBufferImageSave);
 }
 
-void CsCommandBuffer::createBuffer(
+bool CsCommandBuffer::createBuffer(
         vk::UniqueBuffer& buffer,
         vk::UniqueDeviceMemory& bufferMemory,
         vk::DeviceSize& size)
@@ -402,11 +491,24 @@ void CsCommandBuffer::createBuffer(
 
     vk::MemoryRequirements memRequirements = device->getBufferMemoryRequirements(*buffer);
 
-    uint32_t memoryType = findMemoryType(
-                memRequirements.memoryTypeBits,
-                vk::MemoryPropertyFlags(
-                    vk::MemoryPropertyFlagBits::eHostVisible |
-                    vk::MemoryPropertyFlagBits::eHostCoherent));
+    vk::MemoryPropertyFlags properties =
+            vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent;
+
+    uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    // The writer reads the pixels straight from here, which is slow without caching
+    properties |= vk::MemoryPropertyFlagBits::eHostCached;
+    vk::PhysicalDeviceMemoryProperties memProperties = physicalDevice->getMemoryProperties();
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((memRequirements.memoryTypeBits & (1 << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            memoryType = i;
+            break;
+        }
+    }
 
     vk::MemoryAllocateInfo allocInfo(memRequirements.size,
                                      memoryType);
@@ -424,8 +526,32 @@ void CsCommandBuffer::createBuffer(
     }
 #endif
 
+    if (!bufferMemory)
+    {
+        buffer = {};
+        return false;
+    }
+
     auto result = device->bindBufferMemory(*buffer, *bufferMemory, 0);
-    Q_UNUSED(result);
+    if (result == vk::Result::eSuccess)
+    {
+        result = device->mapMemory(
+                    *bufferMemory,
+                    0,
+                    VK_WHOLE_SIZE,
+                    {},
+                    reinterpret_cast<void **>(&pOutputStaging));
+    }
+    if (result != vk::Result::eSuccess)
+    {
+        CS_LOG_WARNING("Failed to map memory.");
+        pOutputStaging = nullptr;
+        bufferMemory = {};
+        buffer = {};
+        return false;
+    }
+
+    return true;
 }
 
 uint32_t CsCommandBuffer::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
@@ -443,6 +569,8 @@ uint32_t CsCommandBuffer::findMemoryType(uint32_t typeFilter, vk::MemoryProperty
 CsCommandBuffer::~CsCommandBuffer()
 {
     CS_LOG_INFO("Destroying command buffer.");
+
+    releaseImageSave();
 }
 
 } // namespace Cascade::Renderer
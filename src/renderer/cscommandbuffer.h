@@ -21,6 +21,7 @@
 #define CSCOMMANDBUFFER_H
 
 #include "csimage.h"
+#include "cssettingsbuffer.h"
 
 namespace Cascade::Renderer {
 
@@ -31,7 +32,8 @@ public:
             const vk::Device* d,
             const vk::PhysicalDevice* pd,
             vk::PipelineLayout* pipelineLayout,
-            vk::DescriptorSet* descriptorSet);
+            vk::DescriptorSet* descriptorSet,
+            CsSettingsBuffer* settings);
 
     void recordGeneric(
             CsImage* const inputImageBack,
@@ -40,13 +42,24 @@ public:
             vk::Pipeline& pl,
             int numShaderPasses,
             int currentShaderPass);
+    // Without a load image, the pixels have to be in tmpImage already
     void recordImageLoad(
             CsImage* const loadImage,
             CsImage* const tmpImage,
             CsImage* const renderTarget,
             vk::Pipeline* const readNodePipeline);
-    vk::DeviceMemory* recordImageSave(
+    // Copies the first rows of bandImage to tmpImage, starting at offsetY
+    void recordImageBandLoad(
+            CsImage* const bandImage,
+            CsImage* const tmpImage,
+            const int offsetY,
+            const int rows);
+    // Returns the mapped staging memory the image is copied
+    // to, it stays valid until the next save or release
+    float* recordImageSave(
             CsImage* const inputImage);
+    // The staging memory is kept for the next save until then
+    void releaseImageSave();
 
     void submitGeneric();
     void submitImageLoad();
@@ -55,6 +68,7 @@ public:
     ~CsCommandBuffer();
 
     vk::Queue* getQueue();
+    bool hasDedicatedQueue() const;
     vk::CommandBuffer* getGeneric();
     vk::CommandBuffer* getImageLoad();
     vk::CommandBuffer* getImageSave();
@@ -64,7 +78,7 @@ private:
     void createComputeCommandPool();
     void createComputeCommandBuffers();
 
-    void createBuffer(
+    bool createBuffer(
             vk::UniqueBuffer& buffer,
             vk::UniqueDeviceMemory& bufferMemory,
             vk::DeviceSize& size);
@@ -79,6 +93,10 @@ private:
 
     vk::UniqueCommandPool computeCommandPool;
     // Command buffer for all shaders except IO
+    // TODO: Independent branches of the graph (the inputs of Merge,
+    // Channel Copy and masked nodes) should get a command buffer and
+    // descriptor set each, submitted together with semaphores on the
+    // dedicated queue instead of waiting for the queue after every node.
     vk::UniqueCommandBuffer commandBufferGeneric;
     // Command buffer for loading images from disk
     vk::UniqueCommandBuffer commandBufferImageLoad;
@@ -88,13 +106,18 @@ private:
     vk::CommandBuffer* currentBuffer;
 
     vk::Queue computeQueue;
+    // False if the queue is shared with the viewer
+    bool dedicatedQueue = false;
     vk::UniqueFence fence;
 
     vk::PipelineLayout* computePipelineLayout;
     vk::DescriptorSet* computeDescriptorSet;
+    CsSettingsBuffer* settingsBuffer;
 
     vk::UniqueBuffer outputStagingBuffer;
     vk::UniqueDeviceMemory outputStagingBufferMemory;
+    vk::DeviceSize outputStagingBufferSize = 0;
+    float* pOutputStaging = nullptr;
 };
 
 } // namespace Cascade::Renderer
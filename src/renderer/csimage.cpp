@@ -32,11 +32,13 @@ CsImage::CsImage(
         const int w,
         const int h,
         const bool isLinear,
-        const char* debugName)
+        const char* debugName,
+        const uint32_t mipLevels)
         : device(d),
           physicalDevice(pd),
           width(w),
-          height(h)
+          height(h),
+          mipLevels(mipLevels)
 {
     window = win;
 
@@ -48,7 +50,7 @@ CsImage::CsImage(
                 vk::ImageType::e2D,
                 vk::Format::eR32G32B32A32Sfloat,
                 vk::Extent3D(width, height, 1),
-                1,
+                mipLevels,
                 1,
                 vk::SampleCountFlagBits::e1,
                 isLinear ? vk::ImageTiling::eLinear :
@@ -97,6 +99,7 @@ CsImage::CsImage(
 
     vk::MemoryAllocateInfo allocInfo(memReq.size, memIndex);
     memory = device->allocateMemoryUnique(allocInfo).value;
+    memorySize = memReq.size;
 
 #ifdef QT_DEBUG
     {
@@ -122,7 +125,7 @@ CsImage::CsImage(
                                      vk::ComponentSwizzle::eA),
                 vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor,
                                           0,
-                                          1,
+                                          mipLevels,
                                           0,
                                           1));
 
@@ -165,7 +168,7 @@ void CsImage::transitionLayoutTo(vk::UniqueCommandBuffer &cb, vk::ImageLayout la
                 {
                     vk::ImageAspectFlagBits::eColor,
                     0,
-                    1,
+                    mipLevels,
                     0,
                     1});
 
@@ -195,6 +198,16 @@ int CsImage::getHeight() const
     return height;
 }
 
+uint32_t CsImage::getMipLevels() const
+{
+    return mipLevels;
+}
+
+vk::DeviceSize CsImage::getMemorySize() const
+{
+    return memorySize;
+}
+
 void CsImage::destroy()
 {
 
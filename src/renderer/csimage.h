@@ -39,7 +39,8 @@ public:
             const int w = 100,
             const int h = 100,
             const bool isLinear = false,
-            const char* debugName = "Unnamed");
+            const char* debugName = "Unnamed",
+            const uint32_t mipLevels = 1);
 
     const vk::UniqueImage& getImage() const;
     const vk::UniqueImageView& getImageView() const;
@@ -52,6 +53,8 @@ public:
 
     int getWidth() const;
     int getHeight() const;
+    uint32_t getMipLevels() const;
+    vk::DeviceSize getMemorySize() const;
 
     void destroy();
 
@@ -70,6 +73,8 @@ private:
 
     const int width;
     const int height;
+    const uint32_t mipLevels;
+    vk::DeviceSize memorySize = 0;
 };
 
 } // end namespace Cascade::Renderer
@@ -19,6 +19,8 @@
 
 #include "cssettingsbuffer.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 #include <QString>
@@ -28,6 +30,9 @@
 
 namespace Cascade::Renderer {
 
+// Enough for a whole graph of settings before the ring wraps around
+static const vk::DeviceSize ringSize = 1024 * 1024;
+
 CsSettingsBuffer::CsSettingsBuffer(
         vk::Device* d,
         vk::PhysicalDevice* pd)
@@ -35,7 +40,11 @@ CsSettingsBuffer::CsSettingsBuffer(
     device = d;
     physicalDevice = pd;
 
-    vk::DeviceSize size = sizeof(float) * 128;
+    alignment = std::max<vk::DeviceSize>(
+                physicalDevice->getProperties().limits.minUniformBufferOffsetAlignment,
+                sizeof(float));
+
+    vk::DeviceSize size = ringSize;
 
     vk::BufferCreateInfo bufferInfo(
                 {},
@@ -85,37 +94,77 @@ CsSettingsBuffer::CsSettingsBuffer(
         CS_LOG_WARNING("Failed to map memory");
 }
 
-void CsSettingsBuffer::fillBuffer(const QString &s)
+float* CsSettingsBuffer::beginSlot()
 {
-    auto parts = s.split(",");
+    slotOffset = (nextOffset + alignment - 1) / alignment * alignment;
 
-    float* pBuffer = pBufferStart;
+    // Slots are always bound with the full range
+    if (slotOffset + getRange() > ringSize)
+        slotOffset = 0;
 
+    nextOffset = slotOffset;
     bufferSize = 0;
 
+    return pBufferStart + slotOffset / sizeof(float);
+}
+
+void CsSettingsBuffer::fillBuffer(const QString &s)
+{
+    auto parts = s.split(",");
+
+    float* pBuffer = beginSlot();
+
     foreach(auto& item, parts)
     {
+        if (bufferSize >= static_cast<int>(maxSettingsValues))
+            break;
+
         *pBuffer = item.toFloat();
         pBuffer++;
         bufferSize++;
     }
+    nextOffset = slotOffset + bufferSize * sizeof(float);
+}
+
+void CsSettingsBuffer::fillBuffer(const float* values, const size_t count)
+{
+    float* pBuffer = beginSlot();
+
+    bufferSize = static_cast<int>(std::min(count, maxSettingsValues));
+
+    memcpy(pBuffer, values, bufferSize * sizeof(float));
+    nextOffset = slotOffset + bufferSize * sizeof(float);
 }
 
 void CsSettingsBuffer::appendValue(float f)
 {
-    float *pBuffer = pBufferStart;
+    if (bufferSize >= static_cast<int>(maxSettingsValues))
+        return;
+
+    float *pBuffer = pBufferStart + slotOffset / sizeof(float);
     pBuffer += bufferSize;
     *pBuffer = f;
     bufferSize++;
+    nextOffset = slotOffset + bufferSize * sizeof(float);
 }
 
 void CsSettingsBuffer::incrementLastValue()
 {
-    float *pBuffer = pBufferStart;
+    float *pBuffer = pBufferStart + slotOffset / sizeof(float);
     pBuffer += bufferSize - 1;
     *pBuffer = *pBuffer + 1.0;
 }
 
+uint32_t CsSettingsBuffer::getOffset() const
+{
+    return static_cast<uint32_t>(slotOffset);
+}
+
+vk::DeviceSize CsSettingsBuffer::getRange() const
+{
+    return maxSettingsValues * sizeof(float);
+}
+
 vk::UniqueBuffer& CsSettingsBuffer::getBuffer()
 {
     return buffer;
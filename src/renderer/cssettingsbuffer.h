@@ -28,6 +28,13 @@
 
 namespace Cascade::Renderer {
 
+// Most values a single dispatch can read, every device
+// supports uniform buffer ranges of at least this size
+inline constexpr size_t maxSettingsValues = 16384 / sizeof(float);
+
+// Ring of settings slots, bound with a dynamic offset. Every fill
+// starts a new slot, earlier slots stay untouched until the ring
+// wraps around to them.
 class CsSettingsBuffer
 {
 public:
@@ -36,9 +43,15 @@ public:
             vk::PhysicalDevice* pd);
 
     void fillBuffer(const QString& s);
+    void fillBuffer(const float* values, const size_t count);
     void appendValue(float f);
     void incrementLastValue();
 
+    // Offset of the slot of the last fill
+    uint32_t getOffset() const;
+    // Every slot is bound with this range
+    vk::DeviceSize getRange() const;
+
     vk::UniqueBuffer& getBuffer();
     vk::UniqueDeviceMemory& getMemory();
 
@@ -51,8 +64,14 @@ private:
     vk::Device* device;
     vk::PhysicalDevice* physicalDevice;
 
+    float* beginSlot();
+
     float* pBufferStart;
-    int bufferSize;
+    int bufferSize = 0;
+
+    vk::DeviceSize alignment = 256;
+    vk::DeviceSize slotOffset = 0;
+    vk::DeviceSize nextOffset = 0;
 };
 
 } // end namespace Cascade::Renderer
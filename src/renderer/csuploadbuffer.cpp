@@ -0,0 +1,133 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "csuploadbuffer.h"
+
+#include "../log.h"
+
+namespace Cascade::Renderer {
+
+static uint32_t findMemoryType(
+        const vk::PhysicalDeviceMemoryProperties& memProperties,
+        const uint32_t memoryTypeBits,
+        const vk::MemoryPropertyFlags properties)
+{
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((memoryTypeBits & (1 << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+    return VK_MAX_MEMORY_TYPES;
+}
+
+CsUploadBuffer::CsUploadBuffer(
+        vk::Device* d,
+        vk::PhysicalDevice* pd,
+        const vk::DeviceSize size)
+{
+    device = d;
+
+    const vk::DeviceSize alignedSize = getBufferSize(size);
+
+    vk::BufferCreateInfo bufferInfo(
+                {},
+                alignedSize,
+                vk::BufferUsageFlagBits::eStorageBuffer,
+                vk::SharingMode::eExclusive);
+
+    buffer = device->createBufferUnique(bufferInfo).value;
+    if (!buffer)
+        return;
+
+    vk::MemoryRequirements memRequirements = device->getBufferMemoryRequirements(*buffer);
+    vk::PhysicalDeviceMemoryProperties memProperties = pd->getMemoryProperties();
+
+    vk::MemoryPropertyFlags properties =
+            vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent;
+
+    // Cached memory is faster to read when colors are converted in place
+    uint32_t memTypeIndex = findMemoryType(
+                memProperties,
+                memRequirements.memoryTypeBits,
+                properties | vk::MemoryPropertyFlagBits::eHostCached);
+    if (memTypeIndex == VK_MAX_MEMORY_TYPES)
+        memTypeIndex = findMemoryType(memProperties, memRequirements.memoryTypeBits, properties);
+    if (memTypeIndex == VK_MAX_MEMORY_TYPES)
+    {
+        buffer = {};
+        return;
+    }
+
+    vk::MemoryAllocateInfo allocInfo(
+                memRequirements.size,
+                memTypeIndex);
+
+    memory = device->allocateMemoryUnique(allocInfo).value;
+    if (!memory)
+    {
+        CS_LOG_WARNING("Could not allocate memory for the upload buffer.");
+        buffer = {};
+        return;
+    }
+
+    auto result = device->bindBufferMemory(*buffer, *memory, 0);
+    if (result == vk::Result::eSuccess)
+        result = device->mapMemory(*memory, 0, VK_WHOLE_SIZE, {}, &pData);
+    if (result != vk::Result::eSuccess)
+    {
+        CS_LOG_WARNING("Failed to map memory");
+        pData = nullptr;
+        return;
+    }
+
+    bufferSize = alignedSize;
+}
+
+vk::DeviceSize CsUploadBuffer::getBufferSize(const vk::DeviceSize size)
+{
+    return (size + 3) / 4 * 4;
+}
+
+void* CsUploadBuffer::getData() const
+{
+    return pData;
+}
+
+vk::DeviceSize CsUploadBuffer::getSize() const
+{
+    return bufferSize;
+}
+
+vk::UniqueBuffer& CsUploadBuffer::getBuffer()
+{
+    return buffer;
+}
+
+CsUploadBuffer::~CsUploadBuffer()
+{
+    if (pData)
+        device->unmapMemory(*memory);
+}
+
+} // end namespace Cascade::Renderer
@@ -0,0 +1,65 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CSUPLOADBUFFER_H
+#define CSUPLOADBUFFER_H
+
+#include <vulkan/vulkan.h>
+
+#include "vulkanhppinclude.h"
+
+namespace Cascade::Renderer {
+
+// Host visible storage buffer that stays mapped for its whole life.
+// Files are decoded straight into it and readbuffer.comp reads them
+// from there, so it can be created on the decode threads.
+class CsUploadBuffer
+{
+public:
+    CsUploadBuffer(
+            vk::Device* d,
+            vk::PhysicalDevice* pd,
+            const vk::DeviceSize size);
+
+    // readbuffer.comp reads whole words, so the
+    // buffer is a multiple of four bytes large
+    static vk::DeviceSize getBufferSize(const vk::DeviceSize size);
+
+    // Null if the buffer could not be created
+    void* getData() const;
+    vk::DeviceSize getSize() const;
+
+    vk::UniqueBuffer& getBuffer();
+
+    ~CsUploadBuffer();
+
+private:
+    vk::UniqueBuffer buffer;
+    vk::UniqueDeviceMemory memory;
+
+    vk::Device* device;
+
+    void* pData = nullptr;
+    vk::DeviceSize bufferSize = 0;
+};
+
+} // end namespace Cascade::Renderer
+
+#endif // CSUPLOADBUFFER_H
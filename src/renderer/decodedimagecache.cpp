@@ -0,0 +1,149 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "decodedimagecache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+
+namespace Cascade::Renderer {
+
+DecodedImageCache::DecodedImageCache(const size_t budget)
+    : budget(budget)
+{
+
+}
+
+QByteArray DecodedImageCache::createKey(
+        const QString& path,
+        const int colorSpace,
+        const OIIO::TypeDesc& format,
+        const int numChannels,
+        const bool isLinear)
+{
+    QFileInfo info(path);
+    if (!info.exists() || !info.isFile())
+        return QByteArray();
+
+    // Depending on the file and the color transforms available, a decode
+    // keeps the type and channels of the file or converts them on the host
+    return info.absoluteFilePath().toUtf8() + "," +
+           QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + "," +
+           QByteArray::number(info.size()) + "," +
+           QByteArray::number(colorSpace) + "," +
+           QByteArray(format.c_str()) + "," +
+           QByteArray::number(numChannels) + "," +
+           (isLinear ? "linear" : "file");
+}
+
+std::shared_ptr<OIIO::ImageBuf> DecodedImageCache::find(const QByteArray& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = index.find(key);
+    if (key.isEmpty() || it == index.end())
+    {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+
+    entries.splice(entries.begin(), entries, it.value());
+
+    return entries.front().image;
+}
+
+bool DecodedImageCache::contains(const QByteArray& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return !key.isEmpty() && index.contains(key);
+}
+
+void DecodedImageCache::insert(const QByteArray& key, std::shared_ptr<OIIO::ImageBuf> image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (key.isEmpty() || !image || index.contains(key))
+        return;
+
+    size_t bytes = image->spec().image_bytes();
+
+    // Would only push out everything else
+    if (bytes > budget)
+        return;
+
+    entries.push_front({ key, std::move(image), bytes });
+    index.insert(key, entries.begin());
+    usedBytes += bytes;
+
+    evict(budget);
+}
+
+void DecodedImageCache::setBudget(const size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    budget = bytes;
+
+    evict(budget);
+}
+
+void DecodedImageCache::evict(const size_t limit)
+{
+    while (usedBytes > limit && !entries.empty())
+    {
+        auto& entry = entries.back();
+        usedBytes -= entry.bytes;
+        index.remove(entry.key);
+        entries.pop_back();
+    }
+}
+
+void DecodedImageCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    index.clear();
+    entries.clear();
+    usedBytes = 0;
+}
+
+int DecodedImageCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return hits;
+}
+
+int DecodedImageCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return misses;
+}
+
+size_t DecodedImageCache::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return usedBytes;
+}
+
+} // namespace Cascade::Renderer
@@ -0,0 +1,94 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DECODEDIMAGECACHE_H
+#define DECODEDIMAGECACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <OpenImageIO/imagebuf.h>
+
+namespace Cascade::Renderer {
+
+inline constexpr size_t defaultDecodedImageCacheBudget = size_t(2048) * 1024 * 1024;
+
+// Files that were read, so a Read node can switch back to one of
+// them without decoding it again. Pixels are kept in the layout the
+// decode left them in, colors might still be converted on upload.
+// Entries are shared with whoever uploads them.
+class DecodedImageCache
+{
+public:
+    explicit DecodedImageCache(const size_t budget = defaultDecodedImageCacheBudget);
+
+    // Empty if the file does not exist. A file that was
+    // written to since it was cached gets a different key,
+    // and so does another pixel layout of the same file.
+    static QByteArray createKey(
+            const QString& path,
+            const int colorSpace,
+            const OIIO::TypeDesc& format,
+            const int numChannels,
+            const bool isLinear);
+
+    std::shared_ptr<OIIO::ImageBuf> find(const QByteArray& key);
+    bool contains(const QByteArray& key) const;
+
+    void insert(const QByteArray& key, std::shared_ptr<OIIO::ImageBuf> image);
+
+    void setBudget(const size_t bytes);
+
+    void clear();
+
+    int getHits() const;
+    int getMisses() const;
+    size_t getUsedBytes() const;
+
+private:
+    struct Entry
+    {
+        QByteArray key;
+        std::shared_ptr<OIIO::ImageBuf> image;
+        size_t bytes;
+    };
+
+    void evict(const size_t limit);
+
+    // Most recently used entry first
+    std::list<Entry> entries;
+    QHash<QByteArray, std::list<Entry>::iterator> index;
+
+    size_t budget;
+    size_t usedBytes = 0;
+
+    int hits = 0;
+    int misses = 0;
+
+    mutable std::mutex mutex;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // DECODEDIMAGECACHE_H
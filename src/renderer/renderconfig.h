@@ -36,17 +36,29 @@ inline const QByteArrayList instanceLayers =
 
 inline const QByteArrayList instanceExtensions =
 {
+    "VK_KHR_get_physical_device_properties2",
 #ifdef QT_DEBUG
     "VK_EXT_debug_utils"
 #endif
 };
 
+inline const QByteArrayList deviceExtensions =
+{
+    "VK_EXT_memory_budget"
+};
+
 inline constexpr vk::Format globalImageFormat(vk::Format::eR32G32B32A32Sfloat);
 
 inline const vk::ClearColorValue clearColor(std::array<float, 4>({ 0.05f, 0.05f, 0.05f, 0.0f }));
 
 inline constexpr int uniformDataSize = 16 * sizeof(float);
 
+// Files too large for the image cache are uploaded in bands of about this size
+inline constexpr size_t streamBandBytes = 64 * 1024 * 1024;
+
+// Files a batch render decodes ahead of the one it is saving
+inline constexpr int batchPrefetchCount = 4;
+
 inline const std::unordered_map<int, QString> colorSpaces =
 {
     { 0, "sRGB" },
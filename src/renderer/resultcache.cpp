@@ -0,0 +1,142 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "resultcache.h"
+
+#include <iterator>
+
+namespace Cascade::Renderer {
+
+ResultCache::ResultCache(const size_t budget)
+    : budget(budget)
+{
+
+}
+
+std::unique_ptr<CsImage> ResultCache::take(const QByteArray& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = index.find(key);
+    if (it == index.end())
+    {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+
+    auto entry = it.value();
+    auto image = std::move(entry->image);
+    usedBytes -= entry->bytes;
+
+    entries.erase(entry);
+    index.erase(it);
+
+    return image;
+}
+
+std::vector<std::unique_ptr<CsImage>> ResultCache::insert(
+        const QByteArray& key,
+        std::unique_ptr<CsImage> image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<std::unique_ptr<CsImage>> evicted;
+
+    // An identical result is already stored
+    if (index.contains(key))
+    {
+        evicted.push_back(std::move(image));
+        return evicted;
+    }
+
+    size_t bytes = image->getMemorySize();
+
+    entries.push_front({ key, std::move(image), bytes });
+    index.insert(key, entries.begin());
+    usedBytes += bytes;
+
+    auto evictedByBudget = evict(budget);
+    std::move(evictedByBudget.begin(), evictedByBudget.end(), std::back_inserter(evicted));
+
+    return evicted;
+}
+
+std::vector<std::unique_ptr<CsImage>> ResultCache::setBudget(const size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    budget = bytes;
+
+    return evict(budget);
+}
+
+std::vector<std::unique_ptr<CsImage>> ResultCache::evictBytes(const size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return evict(usedBytes > bytes ? usedBytes - bytes : 0);
+}
+
+std::vector<std::unique_ptr<CsImage>> ResultCache::evict(const size_t limit)
+{
+    std::vector<std::unique_ptr<CsImage>> evicted;
+
+    while (usedBytes > limit && !entries.empty())
+    {
+        auto& entry = entries.back();
+        usedBytes -= entry.bytes;
+        index.remove(entry.key);
+        evicted.push_back(std::move(entry.image));
+        entries.pop_back();
+    }
+    return evicted;
+}
+
+void ResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    index.clear();
+    entries.clear();
+    usedBytes = 0;
+}
+
+int ResultCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return hits;
+}
+
+int ResultCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return misses;
+}
+
+size_t ResultCache::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return usedBytes;
+}
+
+} // namespace Cascade::Renderer
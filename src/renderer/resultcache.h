@@ -0,0 +1,87 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+
+#include "csimage.h"
+
+namespace Cascade::Renderer {
+
+inline constexpr size_t defaultResultCacheBudget = size_t(1024) * 1024 * 1024;
+
+// Node results that are not shown by any node right now, keyed by a hash
+// of everything that went into them. Least recently used images are
+// handed back to the caller once the cache grows past its budget.
+class ResultCache
+{
+public:
+    explicit ResultCache(const size_t budget = defaultResultCacheBudget);
+
+    // The image leaves the cache, it belongs to the caller again
+    std::unique_ptr<CsImage> take(const QByteArray& key);
+
+    std::vector<std::unique_ptr<CsImage>> insert(
+            const QByteArray& key,
+            std::unique_ptr<CsImage> image);
+
+    std::vector<std::unique_ptr<CsImage>> setBudget(const size_t bytes);
+    // Frees at least the given amount of memory if there is that much
+    std::vector<std::unique_ptr<CsImage>> evictBytes(const size_t bytes);
+
+    void clear();
+
+    int getHits() const;
+    int getMisses() const;
+    size_t getUsedBytes() const;
+
+private:
+    struct Entry
+    {
+        QByteArray key;
+        std::unique_ptr<CsImage> image;
+        size_t bytes;
+    };
+
+    std::vector<std::unique_ptr<CsImage>> evict(const size_t limit);
+
+    // Most recently used entry first
+    std::list<Entry> entries;
+    QHash<QByteArray, std::list<Entry>::iterator> index;
+
+    size_t budget;
+    size_t usedBytes = 0;
+
+    int hits = 0;
+    int misses = 0;
+
+    mutable std::mutex mutex;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // RESULTCACHE_H
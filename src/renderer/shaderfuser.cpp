@@ -0,0 +1,295 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "shaderfuser.h"
+
+#include <algorithm>
+
+#include <QFile>
+#include <QRegularExpression>
+
+#include "cssettingsbuffer.h"
+#include "../log.h"
+#include "../shadercompiler/SpvShaderCompiler.h"
+
+namespace Cascade::Renderer {
+
+// Nodes that read and write nothing but the pixel they are run for
+static const std::vector<NodeType> fusableNodeTypes =
+{
+    NODE_TYPE_CLAMP,
+    NODE_TYPE_COLOR_BALANCE,
+    NODE_TYPE_COLOR_MAP,
+    NODE_TYPE_HUE_SATURATION,
+    NODE_TYPE_INVERT,
+    NODE_TYPE_LEVELS,
+    NODE_TYPE_PREMULT,
+    NODE_TYPE_SOLARIZE,
+    NODE_TYPE_UNPREMULT
+};
+
+// Values a dispatch can read from CsSettingsBuffer
+static const int maxFusedParameters = static_cast<int>(maxSettingsValues);
+
+void ShaderFuser::setUp()
+{
+    for (auto type : fusableNodeTypes)
+    {
+        auto props = getPropertiesForType(type);
+
+        if (props.numShaderPasses != 1)
+            continue;
+
+        QString path = props.shaderPath;
+        path.replace("_comp.spv", ".comp");
+
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            CS_LOG_WARNING("Could not open shader source: " + path);
+            continue;
+        }
+
+        if (!parseStage(type, QString::fromUtf8(file.readAll())))
+            CS_LOG_WARNING("Shader can not be fused: " + path);
+    }
+}
+
+bool ShaderFuser::canFuse(const NodeType type) const
+{
+    return stages.find(type) != stages.end();
+}
+
+bool ShaderFuser::canFuse(const std::vector<NodeType>& types) const
+{
+    int count = 0;
+    for (auto type : types)
+    {
+        if (!canFuse(type))
+            return false;
+
+        count += getParameterCount(type);
+    }
+    return count <= maxFusedParameters;
+}
+
+int ShaderFuser::getParameterCount(const NodeType type) const
+{
+    auto it = stages.find(type);
+    if (it == stages.end())
+        return 0;
+
+    return it->second.parameterCount;
+}
+
+const std::vector<unsigned int>& ShaderFuser::getFusedShader(const std::vector<NodeType>& types)
+{
+    QByteArray key;
+    for (auto type : types)
+        key += QByteArray::number(type) + ",";
+
+    auto it = fusedShaders.find(key);
+    if (it != fusedShaders.end())
+        return it.value();
+
+    // Failures are remembered too, so they are not compiled again
+    std::vector<unsigned int> code;
+
+    if (canFuse(types))
+    {
+        SpvCompiler compiler;
+        if (compiler.compileGLSLFromCode(createFusedCode(types).toStdString(), "comp"))
+        {
+            code = compiler.getSpirV();
+        }
+        else
+        {
+            CS_LOG_WARNING("Compilation of fused shader failed:");
+            CS_LOG_WARNING(QString::fromStdString(compiler.getError()));
+        }
+    }
+
+    return fusedShaders.insert(key, code).value();
+}
+
+bool ShaderFuser::parseStage(const NodeType type, const QString& source)
+{
+    QString code = source;
+
+    code.remove(QRegularExpression("/\\*.*?\\*/", QRegularExpression::DotMatchesEverythingOption));
+    code.remove(QRegularExpression("//[^\n]*"));
+    code.remove(QRegularExpression("#version[^\n]*"));
+    code.remove(QRegularExpression("layout\\s*\\(\\s*local_size[^)]*\\)\\s*in\\s*;"));
+
+    // Back, front and result image
+    QString images[3];
+    QRegularExpression imageExpr(
+                "layout\\s*\\(\\s*binding\\s*=\\s*(\\d)\\s*,\\s*rgba32f\\s*\\)"
+                "\\s*uniform\\s+(?:readonly\\s+)?image2D\\s+(\\w+)\\s*;");
+    auto imageMatches = imageExpr.globalMatch(code);
+    while (imageMatches.hasNext())
+    {
+        auto match = imageMatches.next();
+        int binding = match.captured(1).toInt();
+        if (binding < 3)
+            images[binding] = match.captured(2);
+    }
+    code.remove(imageExpr);
+
+    if (images[0].isEmpty() || images[2].isEmpty())
+        return false;
+
+    Stage stage;
+
+    QRegularExpression bufferExpr(
+                "layout\\s*\\([^)]*binding\\s*=\\s*3\\s*\\)\\s*uniform\\s+\\w+\\s*\\{([^}]*)\\}\\s*sb\\s*;");
+    auto bufferMatch = bufferExpr.match(code);
+    if (bufferMatch.hasMatch())
+    {
+        QRegularExpression memberExpr("layout\\s*\\(\\s*offset\\s*=\\s*(\\d+)\\s*\\)\\s*float\\s+(\\w+)\\s*;");
+        QString members = bufferMatch.captured(1);
+
+        auto memberMatches = memberExpr.globalMatch(members);
+        while (memberMatches.hasNext())
+        {
+            auto match = memberMatches.next();
+            int offset = match.captured(1).toInt();
+            stage.members.append({ offset, match.captured(2) });
+            stage.parameterCount = std::max(stage.parameterCount, offset / 4 + 1);
+        }
+
+        // Anything but single floats would need its own alignment
+        if (!members.remove(memberExpr).trimmed().isEmpty())
+            return false;
+
+        code.remove(bufferMatch.capturedStart(), bufferMatch.capturedLength());
+    }
+
+    QRegularExpression defineExpr("#define[^\n]*");
+    auto defineMatches = defineExpr.globalMatch(code);
+    while (defineMatches.hasNext())
+        stage.defines.append(defineMatches.next().captured(0));
+    code.remove(defineExpr);
+
+    // Nothing but main() may be left
+    QRegularExpression mainExpr("void\\s+main\\s*\\(\\s*\\)\\s*\\{");
+    auto mainMatch = mainExpr.match(code);
+    int bodyEnd = code.lastIndexOf('}');
+    if (!mainMatch.hasMatch() ||
+        !code.left(mainMatch.capturedStart()).trimmed().isEmpty() ||
+        !code.mid(bodyEnd + 1).trimmed().isEmpty())
+    {
+        return false;
+    }
+    QString body = code.mid(mainMatch.capturedEnd(), bodyEnd - mainMatch.capturedEnd());
+
+    const QString coords = "\\s*(?:pixelCoords|ivec2\\s*\\(\\s*gl_GlobalInvocationID\\.xy\\s*\\))\\s*";
+
+    body.replace(QRegularExpression(
+                     "imageLoad\\s*\\(\\s*" + images[0] + "\\s*," + coords + "\\)"),
+                 "fusedPixel");
+    // Fused nodes never have a mask connected
+    if (!images[1].isEmpty())
+    {
+        body.replace(QRegularExpression(
+                         "imageLoad\\s*\\(\\s*" + images[1] + "\\s*," + coords + "\\)"),
+                     "vec4(0.0)");
+    }
+    body.replace(QRegularExpression(
+                     "imageStore\\s*\\(\\s*" + images[2] + "\\s*," + coords + ",([^;]*)\\)\\s*;"),
+                 "return \\1;");
+    body.replace(QRegularExpression("\\breturn\\s*;"), "return fusedPixel;");
+    body.replace(QRegularExpression("imageSize\\s*\\(\\s*" + images[0] + "\\s*\\)"),
+                 "imageSize(fusedInput)");
+
+    // Neighbouring pixels can only be read from an image
+    if (body.contains(QRegularExpression("\\bimage(Load|Store)\\b")))
+        return false;
+
+    stage.body = body;
+    stages[type] = stage;
+
+    return true;
+}
+
+QString ShaderFuser::createFusedCode(const std::vector<NodeType>& types) const
+{
+    QString members;
+    QString functions;
+    QString calls;
+
+    // Every stage reads its settings from where they are placed in the buffer
+    int base = 0;
+
+    for (size_t i = 0; i < types.size(); ++i)
+    {
+        const Stage& stage = stages.at(types[i]);
+        const QString prefix = QString("s%1_").arg(i);
+
+        foreach (auto& member, stage.members)
+        {
+            members += QString("    layout(offset = %1) float %2%3;\n")
+                    .arg(base * 4 + member.first)
+                    .arg(prefix, member.second);
+        }
+
+        QString body = stage.body;
+        body.replace(QRegularExpression("\\bsb\\.(\\w+)"), "sb." + prefix + "\\1");
+
+        foreach (auto define, stage.defines)
+        {
+            QString name = define.section(QRegularExpression("\\s+"), 1, 1);
+            QRegularExpression nameExpr("\\b" + name + "\\b");
+            define.replace(nameExpr, prefix.toUpper() + name);
+            body.replace(nameExpr, prefix.toUpper() + name);
+            functions += define + "\n";
+        }
+
+        functions += QString("vec4 stage%1(vec4 fusedPixel)\n{").arg(i);
+        functions += body;
+        functions += "    return fusedPixel;\n}\n\n";
+
+        calls += QString("    fusedPixel = stage%1(fusedPixel);\n").arg(i);
+
+        base += stage.parameterCount;
+    }
+
+    QString code =
+            "#version 430\n\n"
+            "layout (local_size_x = 16, local_size_y = 16) in;\n"
+            "layout (binding = 0, rgba32f) uniform readonly image2D fusedInput;\n"
+            "layout (binding = 1, rgba32f) uniform readonly image2D fusedMask;\n"
+            "layout (binding = 2, rgba32f) uniform image2D fusedResult;\n\n";
+
+    if (!members.isEmpty())
+        code += "layout(set = 0, binding = 3) uniform InputBuffer\n{\n" + members + "} sb;\n\n";
+
+    code += functions;
+    code += "void main()\n"
+            "{\n"
+            "    ivec2 pixelCoords = ivec2(gl_GlobalInvocationID.xy);\n\n"
+            "    vec4 fusedPixel = imageLoad(fusedInput, pixelCoords);\n\n";
+    code += calls;
+    code += "\n    imageStore(fusedResult, pixelCoords, fusedPixel);\n"
+            "}\n";
+
+    return code;
+}
+
+} // namespace Cascade::Renderer
@@ -0,0 +1,73 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHADERFUSER_H
+#define SHADERFUSER_H
+
+#include <map>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include "../nodedefinitions.h"
+
+namespace Cascade::Renderer {
+
+// Turns the shaders of nodes that only look at the pixel they write
+// into functions, so a chain of them can run as a single dispatch
+// without storing the images in between.
+class ShaderFuser
+{
+public:
+    void setUp();
+
+    bool canFuse(const NodeType type) const;
+    // Every stage has to fit into the settings buffer
+    bool canFuse(const std::vector<NodeType>& types) const;
+
+    // Number of floats the settings of a node take up in the fused buffer
+    int getParameterCount(const NodeType type) const;
+
+    // Empty if the chain could not be compiled
+    const std::vector<unsigned int>& getFusedShader(const std::vector<NodeType>& types);
+
+private:
+    struct Stage
+    {
+        QString body;
+        QStringList defines;
+        // Offset in bytes and name of each settings member
+        QList<QPair<int, QString>> members;
+        int parameterCount = 0;
+    };
+
+    bool parseStage(const NodeType type, const QString& source);
+    QString createFusedCode(const std::vector<NodeType>& types) const;
+
+    std::map<NodeType, Stage> stages;
+    QHash<QByteArray, std::vector<unsigned int>> fusedShaders;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // SHADERFUSER_H
@@ -0,0 +1,326 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "spillcache.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <QDir>
+#include <QFile>
+
+#include <OpenImageIO/imagebuf.h>
+
+#include "../log.h"
+
+namespace Cascade::Renderer {
+
+// Files are half floats, compression only makes them smaller
+static size_t getDiskBytes(const size_t bytes)
+{
+    return bytes / 2;
+}
+
+// Reads started ahead that have not been loaded yet
+static constexpr int maxPrefetchedEntries = 2;
+
+void SpillCache::setUp(
+        const size_t host,
+        const size_t disk,
+        const QString& dir)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    hostBudget = host;
+    diskBudget = disk;
+    directory = dir;
+
+    if (!directory.isEmpty() && !QDir().mkpath(directory))
+    {
+        CS_LOG_WARNING("Could not create spill directory " + directory);
+        directory.clear();
+    }
+}
+
+bool SpillCache::isEnabled() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return hostBudget > 0 || (!directory.isEmpty() && diskBudget > 0);
+}
+
+void SpillCache::store(const QByteArray& key, std::shared_ptr<SpilledImage> image)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (entries.contains(key))
+        return;
+
+    Entry& entry = entries[key];
+    entry.image = image;
+    entry.bytes = image->pixels.size() * sizeof(float);
+    hostEntries.push_front(key);
+    usedBytes += entry.bytes;
+
+    // Oldest copies go to disk first
+    while (usedBytes > hostBudget && !hostEntries.empty())
+    {
+        QByteArray oldest = hostEntries.back();
+        hostEntries.pop_back();
+
+        Entry& e = entries[oldest];
+        usedBytes -= e.bytes;
+
+        if (!moveToDisk(oldest, e))
+            entries.remove(oldest);
+    }
+
+    enforceDiskBudget();
+}
+
+bool SpillCache::moveToDisk(const QByteArray& key, Entry& entry)
+{
+    auto image = std::move(entry.image);
+    entry.image = nullptr;
+
+    if (directory.isEmpty() || diskBudget == 0)
+        return false;
+
+    // Written on a worker, the caller might be the GUI thread
+    entry.path = createPath(key);
+    entry.written = std::async(std::launch::async, &SpillCache::writeExr, entry.path, image).share();
+
+    diskEntries.push_front(key);
+    diskBytes += getDiskBytes(entry.bytes);
+
+    return true;
+}
+
+void SpillCache::enforceDiskBudget()
+{
+    while (diskBytes > diskBudget && !diskEntries.empty())
+    {
+        QByteArray oldest = diskEntries.back();
+
+        removeDiskCopy(oldest, entries[oldest]);
+        entries.remove(oldest);
+    }
+}
+
+void SpillCache::removeDiskCopy(const QByteArray& key, Entry& entry)
+{
+    diskEntries.remove(key);
+    diskBytes -= getDiskBytes(entry.bytes);
+    if (entry.isPrefetched)
+        prefetchedEntries--;
+
+    diskTasks.remove_if([](std::future<void>& task)
+    {
+        return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+
+    // The file might still be written or read
+    diskTasks.push_back(std::async(
+                            std::launch::async,
+                            [path = entry.path, written = entry.written, pending = entry.pending]()
+    {
+        if (written.valid())
+            written.wait();
+        if (pending.valid())
+            pending.wait();
+        QFile::remove(path);
+    }));
+}
+
+std::shared_future<std::shared_ptr<SpilledImage>> SpillCache::startReading(
+        const Entry& entry,
+        const std::launch policy) const
+{
+    return std::async(policy, [path = entry.path, written = entry.written]()
+    {
+        if (written.valid() && !written.get())
+            return std::shared_ptr<SpilledImage>();
+
+        return readExr(path);
+    }).share();
+}
+
+bool SpillCache::contains(const QByteArray& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return entries.contains(key);
+}
+
+size_t SpillCache::getBytes(const QByteArray& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    return it != entries.end() ? it->bytes : 0;
+}
+
+void SpillCache::prefetch(const QByteArray& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    if (it == entries.end() || it->image || it->pending.valid() ||
+        prefetchedEntries >= maxPrefetchedEntries)
+    {
+        return;
+    }
+
+    it->pending = startReading(*it, std::launch::async);
+    it->isPrefetched = true;
+    prefetchedEntries++;
+}
+
+std::shared_ptr<SpilledImage> SpillCache::load(const QByteArray& key)
+{
+    std::shared_future<std::shared_ptr<SpilledImage>> pending;
+    QString path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = entries.find(key);
+        if (it == entries.end())
+            return nullptr;
+
+        if (it->image)
+        {
+            auto image = it->image;
+            hostEntries.remove(key);
+            usedBytes -= it->bytes;
+            entries.erase(it);
+            return image;
+        }
+        if (!it->pending.valid())
+            it->pending = startReading(*it, std::launch::deferred);
+
+        pending = it->pending;
+        path = it->path;
+        if (it->isPrefetched)
+            prefetchedEntries--;
+
+        diskEntries.remove(key);
+        diskBytes -= getDiskBytes(it->bytes);
+        entries.erase(it);
+    }
+    auto image = pending.get();
+
+    // Reading waited for the write, nothing uses the file anymore
+    QFile::remove(path);
+
+    return image;
+}
+
+void SpillCache::releasePrefetched()
+{
+    std::vector<std::shared_future<std::shared_ptr<SpilledImage>>> reads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& entry : entries)
+        {
+            if (!entry.isPrefetched)
+                continue;
+
+            reads.push_back(std::move(entry.pending));
+            entry.pending = {};
+            entry.isPrefetched = false;
+        }
+        prefetchedEntries = 0;
+    }
+
+    // Outside of the lock, the last reference to a read waits for it
+    reads.clear();
+}
+
+QString SpillCache::createPath(const QByteArray& key) const
+{
+    return QDir(directory).filePath(QString::fromLatin1(key.toHex()) + ".exr");
+}
+
+bool SpillCache::writeExr(const QString& path, std::shared_ptr<SpilledImage> image)
+{
+    OIIO::ImageSpec spec(image->width, image->height, 4, OIIO::TypeDesc::FLOAT);
+    spec.attribute("compression", "zip");
+
+    OIIO::ImageBuf buffer(spec, image->pixels.data());
+    buffer.set_write_format(OIIO::TypeDesc::HALF);
+
+    if (!buffer.write(path.toStdString()))
+    {
+        CS_LOG_WARNING("Could not spill image to disk: " + QString::fromStdString(buffer.geterror()));
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<SpilledImage> SpillCache::readExr(const QString& path)
+{
+    OIIO::ImageBuf buffer(path.toStdString());
+    if (!buffer.read(0, 0, 0, 4, true, OIIO::TypeDesc::FLOAT))
+    {
+        CS_LOG_WARNING("Could not read spilled image: " + QString::fromStdString(buffer.geterror()));
+        return nullptr;
+    }
+
+    auto image = std::make_shared<SpilledImage>();
+    image->width = buffer.spec().width;
+    image->height = buffer.spec().height;
+    image->pixels.resize(size_t(image->width) * image->height * 4);
+
+    buffer.get_pixels(OIIO::ROI::All(), OIIO::TypeDesc::FLOAT, image->pixels.data());
+
+    return image;
+}
+
+void SpillCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& entry : entries)
+    {
+        if (entry.written.valid())
+            entry.written.wait();
+        if (entry.pending.valid())
+            entry.pending.wait();
+        if (!entry.path.isEmpty())
+            QFile::remove(entry.path);
+    }
+    entries.clear();
+    hostEntries.clear();
+    diskEntries.clear();
+    usedBytes = 0;
+    diskBytes = 0;
+    prefetchedEntries = 0;
+
+    for (auto& task : diskTasks)
+        task.wait();
+    diskTasks.clear();
+}
+
+SpillCache::~SpillCache()
+{
+    clear();
+}
+
+} // namespace Cascade::Renderer
@@ -0,0 +1,118 @@
+/*
+ *  Cascade Image Editor
+ *
+ *  Copyright (C) 2022 Till Dechent and contributors
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPILLCACHE_H
+#define SPILLCACHE_H
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+namespace Cascade::Renderer {
+
+struct SpilledImage
+{
+    int width;
+    int height;
+    std::vector<float> pixels;
+};
+
+// Host side copies of node images that were evicted from device memory.
+// Copies that don't fit into the host budget are written to the spill
+// directory as half float EXR files in the background, or dropped if
+// there is none. Files beyond the disk budget are deleted, oldest first.
+class SpillCache
+{
+public:
+    void setUp(
+            const size_t hostBudget,
+            const size_t diskBudget,
+            const QString& directory);
+    bool isEnabled() const;
+
+    void store(const QByteArray& key, std::shared_ptr<SpilledImage> image);
+    bool contains(const QByteArray& key) const;
+    // Size of the pixels of a copy, 0 if there is none
+    size_t getBytes(const QByteArray& key) const;
+
+    // Starts reading a copy from disk in the background, as
+    // long as few enough earlier reads are still held
+    void prefetch(const QByteArray& key);
+    // Takes the copy out of the cache, the image is on the device again
+    std::shared_ptr<SpilledImage> load(const QByteArray& key);
+    // Drops prefetched copies that were not loaded, waits for their reads
+    void releasePrefetched();
+
+    void clear();
+
+    ~SpillCache();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<SpilledImage> image;
+        size_t bytes = 0;
+        QString path;
+        // Reads of the disk copy wait until it is written
+        std::shared_future<bool> written;
+        std::shared_future<std::shared_ptr<SpilledImage>> pending;
+        // Started by prefetch(), counted in prefetchedEntries
+        bool isPrefetched = false;
+    };
+
+    bool moveToDisk(const QByteArray& key, Entry& entry);
+    void enforceDiskBudget();
+    void removeDiskCopy(const QByteArray& key, Entry& entry);
+    std::shared_future<std::shared_ptr<SpilledImage>> startReading(
+            const Entry& entry,
+            const std::launch policy) const;
+    QString createPath(const QByteArray& key) const;
+
+    static bool writeExr(const QString& path, std::shared_ptr<SpilledImage> image);
+    static std::shared_ptr<SpilledImage> readExr(const QString& path);
+
+    QHash<QByteArray, Entry> entries;
+    // Keys of the copies in host memory, most recently used first
+    std::list<QByteArray> hostEntries;
+    // Keys of the copies on disk, most recently spilled first
+    std::list<QByteArray> diskEntries;
+    // Deletions of files that are still written or read
+    std::list<std::future<void>> diskTasks;
+
+    size_t hostBudget = 0;
+    size_t usedBytes = 0;
+    size_t diskBudget = 0;
+    size_t diskBytes = 0;
+    // Prefetched copies are not part of the host budget,
+    // so only this many are read ahead at a time
+    int prefetchedEntries = 0;
+    QString directory;
+
+    mutable std::mutex mutex;
+};
+
+} // namespace Cascade::Renderer
+
+#endif // SPILLCACHE_H
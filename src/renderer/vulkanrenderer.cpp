@@ -19,6 +19,10 @@
 
 #include "vulkanrenderer.h"
 
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
 #include <QVulkanFunctions>
 #include <QCoreApplication>
 #include <QFile>
@@ -34,9 +38,95 @@
 #include "../multithreading.h"
 #include "../log.h"
 #include "renderutility.h"
+#include "../shadercompiler/SpvShaderCompiler.h"
 
 namespace Cascade::Renderer {
 
+// Set on decoded images whose colors were already converted to linear
+static const char* linearAttribute = "cascade:linear";
+
+// Types readbuffer.comp can widen on the device, everything else is read as float
+static OIIO::TypeDesc getUploadFormat(const OIIO::ImageSpec& spec)
+{
+    switch (spec.format.basetype)
+    {
+        case OIIO::TypeDesc::UINT8:
+        case OIIO::TypeDesc::UINT16:
+        case OIIO::TypeDesc::HALF:
+            return OIIO::TypeDesc(OIIO::TypeDesc::BASETYPE(spec.format.basetype));
+        default:
+            return OIIO::TypeDesc::FLOAT;
+    }
+}
+
+// As sourceType in readbuffer.comp
+static int getSourceType(const OIIO::TypeDesc& format)
+{
+    switch (format.basetype)
+    {
+        case OIIO::TypeDesc::UINT8:     return 1;
+        case OIIO::TypeDesc::UINT16:    return 2;
+        case OIIO::TypeDesc::HALF:      return 3;
+        default:                        return 4;
+    }
+}
+
+// What the CPU color conversion works on
+static void expandToFloatRGBA(ImageBuf& image)
+{
+    const int numChannels = image.nchannels();
+    if (image.spec().format == OIIO::TypeDesc::FLOAT && numChannels == 4)
+        return;
+
+    // Gray, gray and alpha, RGB
+    int channelorder[] = { 0, 1, 2, 3 };
+    if (numChannels == 1)
+    {
+        channelorder[1] = 0; channelorder[2] = 0; channelorder[3] = -1;
+    }
+    else if (numChannels == 2)
+    {
+        channelorder[1] = 0; channelorder[2] = 0; channelorder[3] = 1;
+    }
+    else if (numChannels == 3)
+    {
+        channelorder[3] = -1;
+    }
+    float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
+    std::string channelnames[] = { "R", "G", "B", "A" };
+
+    auto expanded = OIIO::ImageBufAlgo::channels(image, 4, channelorder, channelvalues, channelnames);
+
+    ImageBuf result;
+    result.copy(expanded, OIIO::TypeDesc::FLOAT);
+    image = std::move(result);
+}
+
+// Keeps the upload buffer alive as long as an image points into it
+struct UploadBufferDeleter
+{
+    std::shared_ptr<CsUploadBuffer> buffer;
+
+    void operator()(ImageBuf* image) const
+    {
+        delete image;
+    }
+};
+
+// Upload buffers are memory the device maps, which the memory budget
+// does not know about. Images kept for longer go to host memory.
+static std::shared_ptr<ImageBuf> copyToHostMemory(const std::shared_ptr<ImageBuf>& image)
+{
+    if (!std::get_deleter<UploadBufferDeleter>(image))
+        return image;
+
+    auto copy = std::make_shared<ImageBuf>();
+    if (!copy->copy(*image))
+        return nullptr;
+
+    return copy;
+}
+
 // Use a triangle strip to get a quad.
 static float vertexData[] = { // Y up, front = CW
     // x, y, z, u, v
@@ -61,6 +151,7 @@ void VulkanRenderer::initResources()
     // Init all the permanent parts of the renderer
     createVertexBuffer();
     createSampler();
+    createViewerCommandBuffer();
     createDescriptorPool();
     createGraphicsDescriptors();
     createGraphicsPipelineCache();
@@ -79,22 +170,35 @@ void VulkanRenderer::initResources()
                 createShaderFromFile(":/shaders/noop_comp.spv").get());
     // Create a pipeline for each shader
     createComputePipelines();
+    // Fused pipelines are compiled once a chain is rendered
+    shaderFuser.setUp();
+    createReadBufferPipeline();
+    maxSourceBufferRange = physicalDevice.getProperties().limits.maxStorageBufferRange;
+    emptySourceBuffer = std::make_shared<CsUploadBuffer>(&device, &physicalDevice, 16);
+    sourceBuffer = emptySourceBuffer;
 
-    computeCommandBuffer = std::unique_ptr<CsCommandBuffer>(
-                new CsCommandBuffer(&device,
-                                    &physicalDevice,
-                                    &computePipelineLayout.get(),
-                                    &computeDescriptorSet.get()));
+    imageCache = OIIO::ImageCache::create(false);
+    setImageCacheSize(static_cast<int>(imageCacheSize / (1024 * 1024)));
 
     settingsBuffer = std::unique_ptr<CsSettingsBuffer>(new CsSettingsBuffer(
                 &device,
                 &physicalDevice));
 
+    computeCommandBuffer = std::unique_ptr<CsCommandBuffer>(
+                new CsCommandBuffer(&device,
+                                    &physicalDevice,
+                                    &computePipelineLayout.get(),
+                                    &computeDescriptorSet.get(),
+                                    settingsBuffer.get()));
+
     // Load OCIO config
     try
     {
         const char* file = "ocio/config.ocio";
         ocioConfig = OCIO::Config::CreateFromFile(file);
+        colorTransformShaders.setConfig(ocioConfig);
+        colorProcessors.setConfig(ocioConfig);
+        colorProcessors.warmUp();
     }
     catch(OCIO::Exception& exception)
     {
@@ -112,6 +216,34 @@ QString VulkanRenderer::getGpuName()
     return deviceName;
 }
 
+vk::DeviceSize VulkanRenderer::getDeviceMemoryBudget()
+{
+    auto memProperties = physicalDevice.getMemoryProperties();
+    uint32_t heapIndex = memProperties.memoryTypes[window->deviceLocalMemoryIndex()].heapIndex;
+
+    bool hasMemoryBudget =
+            window->vulkanInstance()->extensions().contains("VK_KHR_get_physical_device_properties2") &&
+            window->supportedDeviceExtensions().contains("VK_EXT_memory_budget");
+
+    // Leave room for the viewer, staging images and other applications
+    if (hasMemoryBudget)
+    {
+        auto chain = physicalDevice.getMemoryProperties2KHR<
+                vk::PhysicalDeviceMemoryProperties2,
+                vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        auto& budget = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+        return budget.heapBudget[heapIndex] / 10 * 8;
+    }
+    return memProperties.memoryHeaps[heapIndex].size / 2;
+}
+
+bool VulkanRenderer::canRenderConcurrently()
+{
+    // Evaluating on another thread needs a queue the viewer does not use
+    return computeCommandBuffer && computeCommandBuffer->hasDedicatedQueue();
+}
+
 void VulkanRenderer::createVertexBuffer()
 {
     // The current vertexBuffer will be destroyed,
@@ -181,35 +313,56 @@ void VulkanRenderer::createVertexBuffer()
 
 void VulkanRenderer::createSampler()
 {
-    // Create sampler
+    vk::FormatProperties props = physicalDevice.getFormatProperties(globalImageFormat);
+    canFilterLinear = (bool)(props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+    canBlitMipmaps = (bool)(props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitSrc) &&
+                     (bool)(props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst);
+
+    // Trilinear when zoomed out, but keep the pixels sharp when zoomed in
     vk::SamplerCreateInfo samplerInfo(
                 {},
                 vk::Filter::eNearest,
-                vk::Filter::eNearest,
-                vk::SamplerMipmapMode::eNearest,
+                canFilterLinear ? vk::Filter::eLinear : vk::Filter::eNearest,
+                canFilterLinear ? vk::SamplerMipmapMode::eLinear : vk::SamplerMipmapMode::eNearest,
                 vk::SamplerAddressMode::eClampToEdge,
                 vk::SamplerAddressMode::eClampToEdge,
                 vk::SamplerAddressMode::eClampToEdge,
                 {},
                 false);
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     sampler = device.createSamplerUnique(samplerInfo).value;
 }
 
+void VulkanRenderer::createViewerCommandBuffer()
+{
+    // Blits need a graphics queue, so the viewer mip chain
+    // is not generated on the compute queue
+    vk::CommandBufferAllocateInfo allocInfo(
+                window->graphicsCommandPool(),
+                vk::CommandBufferLevel::ePrimary,
+                1);
+
+    auto buffers = device.allocateCommandBuffersUnique(allocInfo).value;
+    viewerCommandBuffer = std::move(buffers.at(0));
+}
+
 void VulkanRenderer::createDescriptorPool()
 {
     // Create descriptor pool
     std::vector<vk::DescriptorPoolSize> descPoolSizes = {
         { vk::DescriptorType::eUniformBuffer,         3 * uint32_t(concurrentFrameCount) },
+        { vk::DescriptorType::eUniformBufferDynamic,  1 },
         { vk::DescriptorType::eCombinedImageSampler,  1 * uint32_t(concurrentFrameCount) },
         { vk::DescriptorType::eCombinedImageSampler,  1 * uint32_t(concurrentFrameCount) },
-        { vk::DescriptorType::eStorageImage,          6 * uint32_t(concurrentFrameCount) }
+        { vk::DescriptorType::eStorageImage,          6 * uint32_t(concurrentFrameCount) },
+        { vk::DescriptorType::eStorageBuffer,         1 }
     };
 
     vk::DescriptorPoolCreateInfo descPoolInfo(
                 {},
                 6,
-                4,
+                static_cast<uint32_t>(descPoolSizes.size()),
                 descPoolSizes.data());
 
     descriptorPool = device.createDescriptorPoolUnique(descPoolInfo).value;
@@ -271,11 +424,34 @@ void VulkanRenderer::createGraphicsPipelineLayout()
     graphicsPipelineLayout = device.createPipelineLayoutUnique(pipelineLayoutInfo).value;
 }
 
-void VulkanRenderer::fillSettingsBuffer(const NodeBase* node)
+std::vector<float> VulkanRenderer::getScaledParameters(const NodeBase* node, const int renderScale)
+{
+    auto values = node->getParameterSnapshot().values;
+
+    // Scale parameters measured in pixels down to the proxy resolution
+    if (renderScale > 1 && pixelParameters.contains(node->nodeType))
+    {
+        for (auto i : pixelParameters[node->nodeType])
+        {
+            if (i < static_cast<int>(values.size()))
+                values[i] /= renderScale;
+        }
+    }
+
+    return values;
+}
+
+void VulkanRenderer::fillSettingsBuffer(const NodeBase* node, const int renderScale)
 {
-    auto props = node->getAllPropertyValues();
+    if (renderScale == 1)
+    {
+        const auto& values = node->getParameterSnapshot().values;
+        settingsBuffer->fillBuffer(values.data(), values.size());
+        return;
+    }
 
-    settingsBuffer->fillBuffer(props);
+    auto values = getScaledParameters(node, renderScale);
+    settingsBuffer->fillBuffer(values.data(), values.size());
 }
 
 void VulkanRenderer::createGraphicsPipeline(
@@ -479,78 +655,916 @@ bool VulkanRenderer::createComputeRenderTarget(uint32_t width, uint32_t height)
                             false,
                             "Compute Render Target"));
 
-    emit window->renderTargetHasBeenCreated(width, height);
+    emit window->renderTargetHasBeenCreated(width, height);
+
+    currentRenderSize = QSize(width, height);
+
+    return true;
+}
+
+bool VulkanRenderer::getReadNodeFile(const NodeBase* node, QString& path, int& colorSpace) const
+{
+    const auto& values = node->getParameterSnapshot().values;
+    if (values.size() < 2)
+        return false;
+
+    int index = static_cast<int>(values[values.size() - 2]);
+    if ( index < 0 )
+        index = 0;
+    path = node->getParameterSnapshot().text.value(index);
+    colorSpace = static_cast<int>(values.back());
+
+    QFileInfo checkFile(path);
+
+    return path != "" && checkFile.exists() && checkFile.isFile();
+}
+
+std::shared_ptr<ImageBuf> VulkanRenderer::decodeImage(
+        const QString& path,
+        const int colorSpace,
+        DecodeProgress* progress)
+{
+    auto image = std::shared_ptr<ImageBuf>(new ImageBuf(path.toStdString()));
+
+    // Files that don't fit into the image cache are only opened here,
+    // they are read band by band while they are uploaded
+    if (image->init_spec(path.toStdString(), 0, 0) && isStreamed(image->spec()))
+    {
+        image = std::shared_ptr<ImageBuf>(new ImageBuf(path.toStdString(), 0, 0, imageCache));
+        image->read(0, 0, false, OIIO::TypeDesc::UNKNOWN);
+
+        return image;
+    }
+
+    // Called by OIIO while the file is read, returning true stops reading
+    OIIO::ProgressCallback callback = nullptr;
+    if (progress)
+    {
+        callback = [](void* data, float done)
+        {
+            auto p = static_cast<DecodeProgress*>(data);
+            p->done = done;
+            return p->cancelled.load();
+        };
+    }
+
+    if (auto uploadImage = decodeIntoUploadBuffer(path, colorSpace, callback, progress))
+        return uploadImage;
+
+    // Kept in the type and channels of the file, readbuffer.comp
+    // widens them. The error stays on the image for the render thread.
+    if (!image->read(0, 0, 0, 4, true, getUploadFormat(image->spec()), callback, progress))
+        return image;
+
+    if (progress && progress->cancelled)
+        return image;
+
+    // Otherwise the colors are converted on the device after the upload
+    if (!colorTransformShaders.getShader(colorSpaces.at(colorSpace), "linear"))
+    {
+        expandToFloatRGBA(*image);
+        transformColorSpace(colorSpaces.at(colorSpace), "linear", *image);
+        image->specmod().attribute(linearAttribute, 1);
+    }
+
+    return image;
+}
+
+std::shared_ptr<ImageBuf> VulkanRenderer::decodeIntoUploadBuffer(
+        const QString& path,
+        const int colorSpace,
+        OIIO::ProgressCallback callback,
+        DecodeProgress* progress)
+{
+    auto input = OIIO::ImageInput::open(path.toStdString());
+    if (!input)
+    {
+        OIIO::geterror();
+        return nullptr;
+    }
+
+    const OIIO::ImageSpec& fileSpec = input->spec();
+    const int numChannels = std::min(fileSpec.nchannels, 4);
+
+    // Without a device transform the colors are converted in place,
+    // OCIO can only do that for RGB and RGBA
+    const bool transformOnDevice =
+            colorTransformShaders.getShader(colorSpaces.at(colorSpace), "linear") != nullptr;
+    if (!transformOnDevice && numChannels < 3)
+        return nullptr;
+
+    OIIO::ImageSpec spec(
+                fileSpec.width,
+                fileSpec.height,
+                numChannels,
+                transformOnDevice ? getUploadFormat(fileSpec) : OIIO::TypeDesc(OIIO::TypeDesc::FLOAT));
+
+    // The buffer is bound as a whole, the rows are packed as readbuffer.comp reads them
+    const size_t bytes = spec.image_bytes();
+    if (bytes == 0 || CsUploadBuffer::getBufferSize(bytes) > maxSourceBufferRange)
+        return nullptr;
+
+    auto buffer = std::make_shared<CsUploadBuffer>(&device, &physicalDevice, bytes);
+    if (!buffer->getData())
+        return nullptr;
+
+    if (!input->read_image(
+                0, 0, 0, numChannels,
+                spec.format,
+                buffer->getData(),
+                OIIO::AutoStride,
+                OIIO::AutoStride,
+                OIIO::AutoStride,
+                callback,
+                progress))
+    {
+        input->geterror();
+
+        // Cancelled decodes are thrown away anyway
+        if (progress && progress->cancelled)
+            return std::make_shared<ImageBuf>();
+
+        return nullptr;
+    }
+
+    auto image = std::shared_ptr<ImageBuf>(
+                new ImageBuf(spec, buffer->getData()),
+                UploadBufferDeleter { buffer });
+
+    if (!transformOnDevice)
+    {
+        transformColorSpace(colorSpaces.at(colorSpace), "linear", *image);
+        image->specmod().attribute(linearAttribute, 1);
+    }
+
+    return image;
+}
+
+QByteArray VulkanRenderer::getDecodedImageKey(
+        const QString& path,
+        const int colorSpace,
+        const OIIO::ImageSpec& fileSpec)
+{
+    const int numChannels = std::min(fileSpec.nchannels, 4);
+
+    // Same layout as decodeImage() leaves the pixels in
+    if (colorTransformShaders.getShader(colorSpaces.at(colorSpace), "linear"))
+        return DecodedImageCache::createKey(path, colorSpace, getUploadFormat(fileSpec), numChannels, false);
+
+    return DecodedImageCache::createKey(
+                path, colorSpace, OIIO::TypeDesc::FLOAT, numChannels < 3 ? 4 : numChannels, true);
+}
+
+QByteArray VulkanRenderer::getDecodedImageKey(const QString& path, const int colorSpace)
+{
+    auto input = OIIO::ImageInput::open(path.toStdString());
+    if (!input)
+    {
+        OIIO::geterror();
+        return QByteArray();
+    }
+
+    return getDecodedImageKey(path, colorSpace, input->spec());
+}
+
+QByteArray VulkanRenderer::getStoredImageKey(
+        const QString& path,
+        const int colorSpace,
+        const ImageBuf& image) const
+{
+    return DecodedImageCache::createKey(
+                path,
+                colorSpace,
+                image.spec().format,
+                image.nchannels(),
+                image.spec().get_int_attribute(linearAttribute, 0) != 0);
+}
+
+void VulkanRenderer::startDecoding(const std::vector<NodeBase*>& nodes)
+{
+    struct File
+    {
+        NodeBase* node;
+        QString path;
+        int colorSpace;
+        // Shown before, processReadNode() takes it from the cache
+        bool isCached;
+    };
+
+    // The keys open the files, so they are created before locking
+    std::vector<File> files;
+    for (auto node : nodes)
+    {
+        File file;
+        file.node = node;
+        if (!getReadNodeFile(node, file.path, file.colorSpace))
+            continue;
+
+        file.isCached = decodedImages.contains(getDecodedImageKey(file.path, file.colorSpace));
+        files.push_back(file);
+    }
+
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    // Forget about cancelled decodes that have stopped
+    cancelledDecodes.erase(
+                std::remove_if(cancelledDecodes.begin(), cancelledDecodes.end(), [](auto& image)
+    {
+        return image.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }),
+    cancelledDecodes.end());
+
+    for (const auto& file : files)
+    {
+        NodeBase* node = file.node;
+        const QString& path = file.path;
+        const int colorSpace = file.colorSpace;
+        const bool isCached = file.isCached;
+
+        auto it = decodeJobs.find(node);
+        if (it != decodeJobs.end())
+        {
+            // Already on its way
+            if (it->second.path == path && it->second.colorSpace == colorSpace && !isCached)
+                continue;
+
+            // The user picked another file in the meantime
+            it->second.progress->cancelled = true;
+            cancelledDecodes.push_back(std::move(it->second.image));
+            decodeJobs.erase(it);
+        }
+
+        if (isCached)
+            continue;
+
+        // A batch render decoded the file ahead already
+        if (takePrefetchJob(node, path, colorSpace))
+            continue;
+
+        auto promise = std::make_shared<std::promise<std::shared_ptr<ImageBuf>>>();
+
+        auto& job = decodeJobs[node];
+        job.path = path;
+        job.colorSpace = colorSpace;
+        job.progress = std::make_shared<DecodeProgress>();
+        job.image = promise->get_future();
+
+        tbb::this_task_arena::enqueue([this, promise, path, colorSpace, progress = job.progress]()
+        {
+            if (progress->cancelled)
+            {
+                promise->set_value(nullptr);
+                return;
+            }
+            try
+            {
+                promise->set_value(decodeImage(path, colorSpace, progress.get()));
+            }
+            catch (...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+    }
+}
+
+bool VulkanRenderer::isDecoding(const NodeBase* node)
+{
+    float progress = getDecodeProgress(node);
+
+    return progress >= 0.0f && progress < 1.0f;
+}
+
+float VulkanRenderer::getDecodeProgress(const NodeBase* node)
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    auto it = decodeJobs.find(node);
+    if (it == decodeJobs.end())
+    {
+        if (streamProgress && node == streamedNode)
+            return std::min(streamProgress->done.load(), 0.99f);
+
+        return -1.0f;
+    }
+
+    // Reading is done, but colors are still converted
+    if (it->second.image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return std::min(it->second.progress->done.load(), 0.99f);
+
+    return 1.0f;
+}
+
+void VulkanRenderer::cancelDecoding(const NodeBase* node)
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    auto it = decodeJobs.find(node);
+    if (it != decodeJobs.end())
+    {
+        it->second.progress->cancelled = true;
+        cancelledDecodes.push_back(std::move(it->second.image));
+        decodeJobs.erase(it);
+    }
+
+    if (streamProgress && node == streamedNode)
+        streamProgress->cancelled = true;
+}
+
+void VulkanRenderer::cancelStreaming()
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    if (streamProgress)
+        streamProgress->cancelled = true;
+}
+
+void VulkanRenderer::releaseDecodes(const std::vector<NodeBase*>& evaluatedNodes)
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    for (auto it = decodeJobs.begin(); it != decodeJobs.end();)
+    {
+        const bool isEvaluated = std::find(
+                    evaluatedNodes.begin(), evaluatedNodes.end(), it->first) != evaluatedNodes.end();
+        const bool isFinished =
+                it->second.image.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+
+        if (isEvaluated || !isFinished)
+        {
+            ++it;
+            continue;
+        }
+
+        try
+        {
+            auto image = it->second.image.get();
+            if (image && image->initialized() && !image->has_error() && !isStreamed(image->spec()))
+            {
+                decodedImages.insert(
+                            getStoredImageKey(it->second.path, it->second.colorSpace, *image),
+                            copyToHostMemory(image));
+            }
+        }
+        catch (...)
+        {
+            // Read again should the node be viewed once more
+        }
+
+        it = decodeJobs.erase(it);
+    }
+}
+
+void VulkanRenderer::finishDecoding()
+{
+    clearPrefetchedImages();
+
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    for (auto& job : decodeJobs)
+    {
+        job.second.progress->cancelled = true;
+        cancelledDecodes.push_back(std::move(job.second.image));
+    }
+    decodeJobs.clear();
+
+    // Running decodes still use the renderer
+    for (auto& image : cancelledDecodes)
+    {
+        if (image.valid())
+            image.wait();
+    }
+    cancelledDecodes.clear();
+}
+
+void VulkanRenderer::setImageCacheSize(const int megabytes)
+{
+    imageCacheSize = size_t(std::max(megabytes, 1)) * 1024 * 1024;
+
+    if (imageCache)
+        imageCache->attribute("max_memory_MB", static_cast<float>(std::max(megabytes, 1)));
+}
+
+bool VulkanRenderer::isStreamed(const OIIO::ImageSpec& spec) const
+{
+    return size_t(spec.width) * spec.height * 4 * sizeof(float) > imageCacheSize;
+}
+
+bool VulkanRenderer::hasDecodeJob(const NodeBase* node)
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    return decodeJobs.find(node) != decodeJobs.end();
+}
+
+std::shared_ptr<ImageBuf> VulkanRenderer::takeDecodedImage(
+        const NodeBase* node,
+        const QString& path,
+        const int colorSpace)
+{
+    DecodeJob job;
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+
+        auto it = decodeJobs.find(node);
+        if (it != decodeJobs.end())
+        {
+            job = std::move(it->second);
+            decodeJobs.erase(it);
+        }
+    }
+
+    // Waits if the decode has not finished yet
+    if (job.image.valid())
+    {
+        try
+        {
+            auto image = job.image.get();
+            if (image && job.path == path && job.colorSpace == colorSpace)
+                return image;
+        }
+        catch (...)
+        {
+            // Read again below, so the error ends up on the image
+        }
+    }
+
+    if (auto image = takePrefetchedImage(path, colorSpace))
+        return image;
+
+    return decodeImage(path, colorSpace);
+}
+
+void VulkanRenderer::prefetchImage(const QString& path, const int colorSpace)
+{
+    if (prefetchBudget == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    auto key = std::make_pair(path, colorSpace);
+    if (prefetchJobs.find(key) != prefetchJobs.end())
+        return;
+
+    auto promise = std::make_shared<std::promise<std::shared_ptr<ImageBuf>>>();
+
+    auto& job = prefetchJobs[key];
+    job.progress = std::make_shared<DecodeProgress>();
+    job.bytes = std::make_shared<size_t>(0);
+    job.image = promise->get_future();
+
+    // Opening the file might take as long as reading it on network
+    // shares, so the size is only checked against the budget here
+    tbb::this_task_arena::enqueue([this, promise, path, colorSpace, progress = job.progress, bytes = job.bytes]()
+    {
+        try
+        {
+            ImageBuf header(path.toStdString());
+            if (progress->cancelled || !header.init_spec(path.toStdString(), 0, 0) ||
+                isStreamed(header.spec()) ||
+                decodedImages.contains(getDecodedImageKey(path, colorSpace, header.spec())))
+            {
+                promise->set_value(nullptr);
+                return;
+            }
+
+            size_t size = size_t(header.spec().width) * header.spec().height * 4 * sizeof(float);
+            {
+                std::lock_guard<std::mutex> lock(decodeMutex);
+
+                // A Read node might have taken the job over already
+                auto it = prefetchJobs.find(std::make_pair(path, colorSpace));
+                const bool isPrefetch = it != prefetchJobs.end() && it->second.progress == progress;
+
+                if (progress->cancelled || (isPrefetch && prefetchedBytes + size > prefetchBudget))
+                {
+                    promise->set_value(nullptr);
+                    return;
+                }
+                if (isPrefetch)
+                {
+                    prefetchedBytes += size;
+                    *bytes = size;
+                }
+            }
+
+            promise->set_value(decodeImage(path, colorSpace, progress.get()));
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    });
+}
+
+bool VulkanRenderer::takePrefetchJob(
+        const NodeBase* node,
+        const QString& path,
+        const int colorSpace)
+{
+    // Only counted while a batch render prefetches
+    if (prefetchJobs.empty())
+        return false;
+
+    auto it = prefetchJobs.find(std::make_pair(path, colorSpace));
+    if (it == prefetchJobs.end())
+    {
+        prefetchMisses++;
+        return false;
+    }
+
+    auto prefetch = std::move(it->second);
+    prefetchJobs.erase(it);
+
+    prefetchedBytes -= *prefetch.bytes;
+    *prefetch.bytes = 0;
+
+    // Files that did not fit into the budget are decoded as usual
+    if (prefetch.image.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        std::shared_ptr<ImageBuf> image;
+        try
+        {
+            image = prefetch.image.get();
+        }
+        catch (...)
+        {
+        }
+
+        if (!image || image->has_error())
+        {
+            prefetchMisses++;
+            return false;
+        }
+
+        std::promise<std::shared_ptr<ImageBuf>> promise;
+        promise.set_value(image);
+        prefetch.image = promise.get_future();
+    }
+    prefetchHits++;
+
+    auto& job = decodeJobs[node];
+    job.path = path;
+    job.colorSpace = colorSpace;
+    job.progress = prefetch.progress;
+    job.image = std::move(prefetch.image);
+
+    return true;
+}
+
+std::shared_ptr<ImageBuf> VulkanRenderer::takePrefetchedImage(const QString& path, const int colorSpace)
+{
+    PrefetchJob job;
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+
+        // Only counted while a batch render prefetches
+        if (prefetchJobs.empty())
+            return nullptr;
+
+        auto it = prefetchJobs.find(std::make_pair(path, colorSpace));
+        if (it == prefetchJobs.end())
+        {
+            prefetchMisses++;
+            return nullptr;
+        }
+        job = std::move(it->second);
+        prefetchJobs.erase(it);
+    }
+
+    std::shared_ptr<ImageBuf> image;
+    try
+    {
+        image = job.image.get();
+    }
+    catch (...)
+    {
+        // Counted as a miss, the file is decoded again
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        prefetchedBytes -= *job.bytes;
+    }
+
+    if (!image || image->has_error())
+    {
+        prefetchMisses++;
+        return nullptr;
+    }
+    prefetchHits++;
+
+    return image;
+}
+
+void VulkanRenderer::clearPrefetchedImages()
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    for (auto& job : prefetchJobs)
+    {
+        job.second.progress->cancelled = true;
+        prefetchedBytes -= *job.second.bytes;
+        cancelledDecodes.push_back(std::move(job.second.image));
+    }
+    prefetchJobs.clear();
+
+    prefetchHits = 0;
+    prefetchMisses = 0;
+}
+
+void VulkanRenderer::setDecodedImageCacheSize(const int megabytes)
+{
+    decodedImages.setBudget(size_t(std::max(megabytes, 0)) * 1024 * 1024);
+}
+
+void VulkanRenderer::setPrefetchBudget(const int megabytes)
+{
+    prefetchBudget = size_t(std::max(megabytes, 0)) * 1024 * 1024;
+}
+
+int VulkanRenderer::getPrefetchHits() const
+{
+    return prefetchHits;
+}
+
+int VulkanRenderer::getPrefetchMisses() const
+{
+    return prefetchMisses;
+}
+
+bool VulkanRenderer::createImageFromFile(
+        const NodeBase* node,
+        const QString &path,
+        const int colorSpace)
+{
+    cpuImage = decodedImages.find(getDecodedImageKey(path, colorSpace));
+    if (cpuImage)
+    {
+        cancelDecoding(node);
+    }
+    else
+    {
+        cpuImage = takeDecodedImage(node, path, colorSpace);
+        if (cpuImage->has_error() || !cpuImage->initialized())
+        {
+            CS_LOG_WARNING("There was a problem reading the image from disk.");
+            CS_LOG_WARNING(QString::fromStdString(cpuImage->geterror()));
+        }
+        else if (!isStreamed(cpuImage->spec()))
+        {
+            decodedImages.insert(getStoredImageKey(path, colorSpace, *cpuImage), copyToHostMemory(cpuImage));
+        }
+    }
+
+    // Should the device not manage, a copy is converted here
+    transformLoadOnDevice = false;
+    if (cpuImage->initialized() && !cpuImage->spec().get_int_attribute(linearAttribute, 0))
+    {
+        transformLoadOnDevice = prepareDeviceColorTransform(colorSpaces.at(colorSpace), "linear");
+
+        if (!transformLoadOnDevice && !isStreamed(cpuImage->spec()))
+        {
+            auto image = std::make_shared<ImageBuf>(*cpuImage);
+            expandToFloatRGBA(*image);
+            transformColorSpace(colorSpaces.at(colorSpace), "linear", *image);
+            image->specmod().attribute(linearAttribute, 1);
+            cpuImage = image;
+        }
+    }
+
+    // Goes to the device without a staging image of its full size
+    if (isStreamed(cpuImage->spec()))
+        return true;
+
+    const size_t bytes = cpuImage->spec().image_bytes();
+    if (bytes == 0 || !cpuImage->localpixels())
+        return false;
+
+    // Decoded right into the buffer readbuffer.comp reads from
+    if (auto deleter = std::get_deleter<UploadBufferDeleter>(cpuImage))
+    {
+        sourceBuffer = deleter->buffer;
+        return true;
+    }
+
+    // Too large to be bound, it goes through the bands instead
+    if (CsUploadBuffer::getBufferSize(bytes) > maxSourceBufferRange)
+        return true;
+
+    // Converted copies are copied once more
+    auto buffer = std::make_shared<CsUploadBuffer>(&device, &physicalDevice, bytes);
+    if (!buffer->getData())
+        return false;
+
+    std::memcpy(buffer->getData(), cpuImage->localpixels(), bytes);
+    sourceBuffer = buffer;
+
+    return true;
+}
+
+void VulkanRenderer::createReadBufferPipeline()
+{
+    QFile file(":/shaders/readbuffer.comp");
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        CS_LOG_WARNING("Could not open shader source: " + file.fileName());
+        return;
+    }
+
+    SpvCompiler compiler;
+    if (!compiler.compileGLSLFromCode(file.readAll().toStdString(), "comp"))
+    {
+        CS_LOG_WARNING("Compilation of the read shader failed:");
+        CS_LOG_WARNING(QString::fromStdString(compiler.getError()));
+        return;
+    }
+
+    readBufferPipeline = createComputePipeline(createShaderFromCode(compiler.getSpirV()).get());
+}
+
+bool VulkanRenderer::streamImageToDevice(
+        ImageBuf& image,
+        const int colorSpace,
+        CsImage* const target,
+        const bool applyColorSpace,
+        DecodeProgress* progress)
+{
+    const int width = image.spec().width;
+    const int height = image.spec().height;
+    const int numChannels = std::min(image.nchannels(), 4);
+
+    const size_t rowBytes = size_t(width) * 4 * sizeof(float);
+    const int bandRows = std::clamp(static_cast<int>(streamBandBytes / rowBytes), 1, height);
+
+    // While one band is copied on the device, the next is decoded into the other
+    std::unique_ptr<CsImage> bands[2];
+    for (auto& band : bands)
+    {
+        band = std::unique_ptr<CsImage>(
+                    new CsImage(window,
+                                &device,
+                                &physicalDevice,
+                                width,
+                                bandRows,
+                                true,
+                                "Load Image Band"));
+    }
+
+    std::vector<float> pixels(size_t(width) * bandRows * 4);
+
+    bool success = true;
+
+    for (int y = 0, i = 0; y < height && success; y += bandRows, ++i)
+    {
+        if (progress && progress->cancelled)
+        {
+            success = false;
+            break;
+        }
+
+        const int rows = std::min(bandRows, height - y);
+
+        // Files without alpha are opaque
+        if (numChannels < 4)
+            std::fill(pixels.begin(), pixels.end(), 1.0f);
+
+        OIIO::ROI roi(
+                    image.xbegin(), image.xend(),
+                    image.ybegin() + y, image.ybegin() + y + rows,
+                    0, 1,
+                    0, numChannels);
+
+        if (!image.get_pixels(roi, OIIO::TypeDesc::FLOAT, pixels.data(), 4 * sizeof(float), rowBytes))
+        {
+            CS_LOG_WARNING(QString::fromStdString(image.geterror()));
+            success = false;
+            break;
+        }
+
+        if (applyColorSpace)
+        {
+            parallelApplyColorSpace(
+                        colorProcessors.getProcessor(colorSpaces.at(colorSpace), "linear"),
+                        pixels.data(),
+                        width,
+                        rows);
+        }
+
+        auto& band = bands[i % 2];
+        success = writeLinearImage(pixels.data(), QSize(width, rows), band);
+
+        if (success)
+        {
+            // Waits for the band before, which was copied in the meantime
+            computeCommandBuffer->recordImageBandLoad(band.get(), target, y, rows);
+            computeCommandBuffer->submitImageLoad();
+        }
+
+        if (progress)
+            progress->done = static_cast<float>(y + rows) / height;
+    }
+
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
+
+    // The tiles are not needed anymore once they are on the device
+    imageCache->invalidate(OIIO::ustring(image.name()));
+
+    return success;
+}
+
+void VulkanRenderer::transformColorSpace(const QString& from, const QString& to, ImageBuf& image)
+{
+    parallelApplyColorSpace(
+                colorProcessors.getProcessor(from, to),
+                static_cast<float*>(image.localpixels()),
+                image.xend(),
+                image.yend(),
+                image.nchannels());
+}
+
+bool VulkanRenderer::prepareDeviceColorTransform(const QString& from, const QString& to)
+{
+    auto& transform = deviceColorTransforms[std::make_pair(from, to)];
+    if (transform.pipeline)
+        return true;
+
+    auto shader = colorTransformShaders.getShader(from, to);
+    if (!shader)
+        return false;
+
+    if (!shader->lut.empty())
+    {
+        auto lutStaging = std::unique_ptr<CsImage>(
+                    new CsImage(window,
+                                &device,
+                                &physicalDevice,
+                                shader->lutWidth,
+                                shader->lutHeight,
+                                true,
+                                "Color Transform LUT Staging"));
+
+        std::vector<float> values = shader->lut;
+        if (!writeLinearImage(values.data(), QSize(shader->lutWidth, shader->lutHeight), lutStaging))
+            return false;
+
+        transform.lut = std::unique_ptr<CsImage>(
+                    new CsImage(window,
+                                &device,
+                                &physicalDevice,
+                                shader->lutWidth,
+                                shader->lutHeight,
+                                false,
+                                "Color Transform LUT"));
+
+        computeCommandBuffer->recordImageBandLoad(
+                    lutStaging.get(),
+                    transform.lut.get(),
+                    0,
+                    shader->lutHeight);
+        computeCommandBuffer->submitImageLoad();
+
+        auto result = computeCommandBuffer->getQueue()->waitIdle();
+        Q_UNUSED(result);
+    }
 
-    currentRenderSize = QSize(width, height);
+    transform.pipeline = createComputePipeline(createShaderFromCode(shader->code).get());
 
-    return true;
+    return static_cast<bool>(transform.pipeline);
 }
 
-bool VulkanRenderer::createImageFromFile(const QString &path, const int colorSpace)
+bool VulkanRenderer::transformColorSpaceOnDevice(
+        const QString& from,
+        const QString& to,
+        CsImage* const inputImage,
+        CsImage* const outputImage)
 {
-    cpuImage = std::unique_ptr<ImageBuf>(new ImageBuf(path.toStdString()));
-    bool ok = cpuImage->read(0, 0, 0, 4, true, OIIO::TypeDesc::FLOAT);
-    if (!ok)
-    {
-        CS_LOG_WARNING("There was a problem reading the image from disk.");
-        CS_LOG_WARNING(QString::fromStdString(cpuImage->geterror()));
-    }
-    // Add alpha channel if it doesn't exist
-    if (cpuImage->nchannels() == 3)
-    {
-        int channelorder[] = { 0, 1, 2, -1 };
-        float channelvalues[] = { 0 /*ignore*/, 0 /*ignore*/, 0 /*ignore*/, 1.0 };
-        std::string channelnames[] = { "R", "G", "B", "A" };
+    if (!prepareDeviceColorTransform(from, to))
+        return false;
 
-        *cpuImage = OIIO::ImageBufAlgo::channels(*cpuImage, 4, channelorder, channelvalues, channelnames);
-    }
+    auto& transform = deviceColorTransforms[std::make_pair(from, to)];
 
-    transformColorSpace(colorSpaces.at(colorSpace), "linear", *cpuImage);
+    updateComputeDescriptors(inputImage, transform.lut.get(), outputImage);
 
-    updateVertexData(cpuImage->xend(), cpuImage->yend());
+    auto pipeline = transform.pipeline.get();
 
-    auto imageSize = QSize(cpuImage->xend(), cpuImage->yend());
+    computeCommandBuffer->recordGeneric(
+                inputImage,
+                transform.lut.get(),
+                outputImage,
+                pipeline,
+                1,
+                1);
 
-    vk::FormatProperties props = physicalDevice.getFormatProperties(globalImageFormat);
-    const bool canSampleLinear = (bool)(props.linearTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
-    const bool canSampleOptimal = (bool)(props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
-    if (!canSampleLinear && !canSampleOptimal) {
-        CS_LOG_WARNING("Neither linear nor optimal image sampling is supported for image");
-        return false;
-    }
+    computeCommandBuffer->submitGeneric();
 
-    // The image that gets the data from the CPU
-    loadImageStaging = std::unique_ptr<CsImage>(
-                new CsImage(window,
-                            &device,
-                            &physicalDevice,
-                            cpuImage->xend(),
-                            cpuImage->yend(),
-                            true,
-                            "Load Image Staging"));
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
 
-    if (!writeLinearImage(
-                static_cast<float*>(cpuImage->localpixels()),
-                QSize(cpuImage->xend(), cpuImage->yend()),
-                loadImageStaging))
-    {
-        CS_LOG_WARNING("Failed to write linear image");
-        return false;
-    }
     return true;
 }
 
-void VulkanRenderer::transformColorSpace(const QString& from, const QString& to, ImageBuf& image)
-{
-    parallelApplyColorSpace(
-                ocioConfig,
-                from,
-                to,
-                static_cast<float*>(image.localpixels()),
-                image.xend(),
-                image.yend());
-}
-
 void VulkanRenderer::createComputeDescriptors()
 {
     // TODO: Clean this up.
@@ -558,8 +1572,9 @@ void VulkanRenderer::createComputeDescriptors()
     if (!computeDescriptorSetLayout)
     {
         // Define the layout of the input of the shader.
-        // 2 images to read, 1 image to write
-        std::vector<vk::DescriptorSetLayoutBinding> bindings(4);
+        // 2 images to read, 1 image to write, the settings
+        // and the pixels of a file as they were decoded
+        std::vector<vk::DescriptorSetLayoutBinding> bindings(5);
 
         bindings.at(0).binding         = 0;
         bindings.at(0).descriptorType  = vk::DescriptorType::eStorageImage;
@@ -577,13 +1592,18 @@ void VulkanRenderer::createComputeDescriptors()
         bindings.at(2).stageFlags      = vk::ShaderStageFlagBits::eCompute;
 
         bindings.at(3).binding         = 3;
-        bindings.at(3).descriptorType  = vk::DescriptorType::eUniformBuffer;
+        bindings.at(3).descriptorType  = vk::DescriptorType::eUniformBufferDynamic;
         bindings.at(3).descriptorCount = 1;
         bindings.at(3).stageFlags      = vk::ShaderStageFlagBits::eCompute;
 
+        bindings.at(4).binding         = 4;
+        bindings.at(4).descriptorType  = vk::DescriptorType::eStorageBuffer;
+        bindings.at(4).descriptorCount = 1;
+        bindings.at(4).stageFlags      = vk::ShaderStageFlagBits::eCompute;
+
         vk::DescriptorSetLayoutCreateInfo descSetLayoutCreateInfo(
                     {},
-                    4,
+                    5,
                     &bindings.at(0));
 
         computeDescriptorSetLayout = device.createDescriptorSetLayoutUnique(
@@ -657,7 +1677,7 @@ void VulkanRenderer::updateComputeDescriptors(
         const CsImage* const inputImageFront,
         const CsImage* const outputImage)
 {
-    auto result = device.waitIdle();
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
     Q_UNUSED(result);
 
     vk::DescriptorImageInfo sourceInfoBack(
@@ -678,12 +1698,18 @@ void VulkanRenderer::updateComputeDescriptors(
                 *outputImage->getImageView(),
                 vk::ImageLayout::eGeneral);
 
+    // Each dispatch picks its slot with a dynamic offset
     vk::DescriptorBufferInfo settingsBufferInfo(
                 *settingsBuffer->getBuffer(),
                 0,
+                settingsBuffer->getRange());
+
+    vk::DescriptorBufferInfo sourceBufferInfo(
+                *sourceBuffer->getBuffer(),
+                0,
                 VK_WHOLE_SIZE);
 
-    std::vector<vk::WriteDescriptorSet> descWrite(4);
+    std::vector<vk::WriteDescriptorSet> descWrite(5);
 
     descWrite.at(0).dstSet                    = *computeDescriptorSet;
     descWrite.at(0).dstBinding                = 0;
@@ -706,9 +1732,15 @@ void VulkanRenderer::updateComputeDescriptors(
     descWrite.at(3).dstSet                    = *computeDescriptorSet;
     descWrite.at(3).dstBinding                = 3;
     descWrite.at(3).descriptorCount           = 1;
-    descWrite.at(3).descriptorType            = vk::DescriptorType::eUniformBuffer;
+    descWrite.at(3).descriptorType            = vk::DescriptorType::eUniformBufferDynamic;
     descWrite.at(3).pBufferInfo               = &settingsBufferInfo;
 
+    descWrite.at(4).dstSet                    = *computeDescriptorSet;
+    descWrite.at(4).dstBinding                = 4;
+    descWrite.at(4).descriptorCount           = 1;
+    descWrite.at(4).descriptorType            = vk::DescriptorType::eStorageBuffer;
+    descWrite.at(4).pBufferInfo               = &sourceBufferInfo;
+
     device.updateDescriptorSets(descWrite, {});
 }
 
@@ -806,18 +1838,6 @@ bool VulkanRenderer::writeLinearImage(
     return true;
 }
 
-void VulkanRenderer::updateVertexData(const int w, const int h)
-{
-    vertexData[0]  = -0.002 * w;
-    vertexData[5]  = -0.002 * w;
-    vertexData[10] = 0.002 * w;
-    vertexData[15] = 0.002 * w;
-    vertexData[1]  = -0.002 * h;
-    vertexData[6]  = 0.002 * h;
-    vertexData[11] = -0.002 * h;
-    vertexData[16] = 0.002 * h;
-}
-
 void VulkanRenderer::initSwapChainResources()
 {
     // Projection matrix
@@ -832,6 +1852,81 @@ void VulkanRenderer::setDisplayMode(const DisplayMode mode)
     displayMode = mode;
 }
 
+std::unique_ptr<CsImage> VulkanRenderer::uploadImage(
+        float* pixels,
+        const int width,
+        const int height)
+{
+    loadImageStaging = std::unique_ptr<CsImage>(
+                new CsImage(window,
+                            &device,
+                            &physicalDevice,
+                            width,
+                            height,
+                            true,
+                            "Load Image Staging"));
+
+    if (!writeLinearImage(pixels, QSize(width, height), loadImageStaging))
+    {
+        CS_LOG_WARNING("Failed to write linear image");
+        loadImageStaging = nullptr;
+        return nullptr;
+    }
+
+    tmpCacheImage = std::unique_ptr<CsImage>(
+                new CsImage(window,
+                            &device,
+                            &physicalDevice,
+                            width,
+                            height,
+                            false,
+                            "Tmp Cache Image"));
+
+    if (!createComputeRenderTarget(width, height))
+        CS_LOG_WARNING("Failed to create compute render target.");
+
+    updateComputeDescriptors(tmpCacheImage.get(), nullptr, computeRenderTarget.get());
+
+    // Same path as a Read node, only that the pixels are copied as they are
+    computeCommandBuffer->recordImageLoad(
+                loadImageStaging.get(),
+                tmpCacheImage.get(),
+                computeRenderTarget.get(),
+                &computePipelineNoop.get());
+
+    computeCommandBuffer->submitImageLoad();
+
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
+
+    loadImageStaging = nullptr;
+
+    return std::move(computeRenderTarget);
+}
+
+std::vector<float> VulkanRenderer::downloadImage(CsImage* const image)
+{
+    float* pInput = computeCommandBuffer->recordImageSave(image);
+
+    computeCommandBuffer->submitImageSave();
+
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
+
+    const int width = image->getWidth();
+    const int height = image->getHeight();
+
+    std::vector<float> pixels;
+
+    if (!pInput)
+        return pixels;
+
+    pixels.resize(size_t(width) * height * 4);
+    parallelArrayCopy(pInput, pixels.data(), width, height);
+
+    return pixels;
+}
+
 bool VulkanRenderer::saveImageToDisk(
         CsImage* const inputImage,
         const QString &path,
@@ -840,31 +1935,37 @@ bool VulkanRenderer::saveImageToDisk(
 {
     bool success = true;
 
-    auto mem = computeCommandBuffer->recordImageSave(
-                inputImage);
+    // Converted on the device if it can, or on the CPU after the readback
+    const QString& to = colorSpaces.at(colorSpace);
+    std::unique_ptr<CsImage> convertedImage;
+    if (prepareDeviceColorTransform("linear", to))
+    {
+        convertedImage = std::unique_ptr<CsImage>(
+                    new CsImage(window,
+                                &device,
+                                &physicalDevice,
+                                inputImage->getWidth(),
+                                inputImage->getHeight(),
+                                false,
+                                "Save Image"));
+
+        if (!transformColorSpaceOnDevice("linear", to, inputImage, convertedImage.get()))
+            convertedImage = nullptr;
+    }
+
+    float* pInput = computeCommandBuffer->recordImageSave(
+                convertedImage ? convertedImage.get() : inputImage);
 
     computeCommandBuffer->submitImageSave();
 
     auto result = device.waitIdle();
+    Q_UNUSED(result);
 
-    float *pInput;
-    result = device.mapMemory(
-                *mem,
-                0,
-                VK_WHOLE_SIZE,
-                {},
-                reinterpret_cast<void **>(&pInput));
-    if (result != vk::Result::eSuccess)
-        CS_LOG_WARNING("Failed to map memory.");
+    if (!pInput)
+        return false;
 
     int width = inputImage->getWidth();
     int height = inputImage->getHeight();
-    int numValues = width * height * 4;
-
-    float* output = new float[numValues];
-    float* pOutput = &output[0];
-
-    parallelArrayCopy(pInput, pOutput, width, height);
 
     OIIO::ImageSpec spec(width, height, 4, OIIO::TypeDesc::FLOAT);
     QMap<std::string, std::string>::const_iterator it;
@@ -872,10 +1973,13 @@ bool VulkanRenderer::saveImageToDisk(
     {
         spec.attribute(it.key(), it.value());
     }
+
+    // Written straight from the staging memory, which is overwritten by the next save
     std::unique_ptr<ImageBuf> saveImage =
-            std::unique_ptr<ImageBuf>(new ImageBuf(spec, output));
+            std::unique_ptr<ImageBuf>(new ImageBuf(spec, pInput));
 
-    transformColorSpace("linear", colorSpaces.at(colorSpace), *saveImage);
+    if (!convertedImage)
+        transformColorSpace("linear", to, *saveImage);
 
     success = saveImage->write(path.toStdString());
 
@@ -884,13 +1988,14 @@ bool VulkanRenderer::saveImageToDisk(
         CS_LOG_INFO("Problem saving image." + QString::fromStdString(saveImage->geterror()));
     }
 
-    delete[] output;
-
-    device.unmapMemory(*mem);
-
     return success;
 }
 
+void VulkanRenderer::releaseImageSaveBuffer()
+{
+    computeCommandBuffer->releaseImageSave();
+}
+
 void VulkanRenderer::createRenderPass()
 {
     vk::CommandBuffer cb = window->currentCommandBuffer();
@@ -942,7 +2047,12 @@ void VulkanRenderer::createRenderPass()
     scale.setToIdentity();
     scale.scale(scaleXY, scaleXY, scaleXY);
 
-    m = m * translation * scale;
+    // The vertex buffer holds a unit quad, stretch it to the image size
+    QMatrix4x4 imageSize;
+    imageSize.setToIdentity();
+    imageSize.scale(0.002f * outputImageSize.width(), 0.002f * outputImageSize.height(), 1.0f);
+
+    m = m * translation * scale * imageSize;
 
     memcpy(p, m.constData(), 16 * sizeof(float));
     device.unmapMemory(*vertexBufferMemory);
@@ -1009,71 +2119,201 @@ void VulkanRenderer::setViewerPushConstants(const QString &s)
     viewerPushConstants = unpackPushConstants(s);
 }
 
-void VulkanRenderer::processReadNode(NodeBase *node)
+bool VulkanRenderer::processReadNode(NodeBase *node, const bool needsDecode, const int renderScale)
 {
-    auto parts = node->getAllPropertyValues().split(",");
-    int index = parts[parts.size() - 2].toInt();
-    if ( index < 0 )
-        index = 0;
-    QString path = parts[index];
-    int colorSpace = parts.last().toInt();
+    // Only decode again if the file or its settings changed,
+    // a change of render scale reuses the full resolution source.
+    // A decode that finished after an earlier evaluation is picked up.
+    if (!needsDecode && node->getSourceImage() && !hasDecodeJob(node))
+    {
+        createProxyImage(node, renderScale);
+        return true;
+    }
 
-    QFileInfo checkFile(path);
+    QString path;
+    int colorSpace;
 
-    if(path != "" && checkFile.exists() && checkFile.isFile())
+    if (getReadNodeFile(node, path, colorSpace))
     {
         imagePath = path;
 
         // Create texture
-        if (!createImageFromFile(imagePath, colorSpace))
+        if (!createImageFromFile(node, imagePath, colorSpace))
             CS_LOG_WARNING("Failed to create texture");
 
-        tmpCacheImage = std::unique_ptr<CsImage>(
-                    new CsImage(window,
-                                &device,
-                                &physicalDevice,
-                                cpuImage->xend(),
-                                cpuImage->yend(),
-                                false,
-                                "Tmp Cache Image"));
+        const int width = cpuImage->spec().width;
+        const int height = cpuImage->spec().height;
 
         // Create render target
-        if (!createComputeRenderTarget(cpuImage->xend(), cpuImage->yend()))
+        if (!createComputeRenderTarget(width, height))
             CS_LOG_WARNING("Failed to create compute render target.");
 
-        updateComputeDescriptors(tmpCacheImage.get(), nullptr, computeRenderTarget.get());
+        // Should readbuffer.comp not have compiled, files go through the bands as well
+        if (isStreamed(cpuImage->spec()) || !readBufferPipeline || sourceBuffer == emptySourceBuffer)
+        {
+            tmpCacheImage = std::unique_ptr<CsImage>(
+                        new CsImage(window,
+                                    &device,
+                                    &physicalDevice,
+                                    width,
+                                    height,
+                                    false,
+                                    "Tmp Cache Image"));
+
+            updateComputeDescriptors(tmpCacheImage.get(), nullptr, computeRenderTarget.get());
 
-        computeCommandBuffer->recordImageLoad(
-                    loadImageStaging.get(),
-                    tmpCacheImage.get(),
-                    computeRenderTarget.get(),
-                    &pipelines[NODE_TYPE_READ].get());
+            const bool applyColorSpace =
+                    !transformLoadOnDevice && !cpuImage->spec().get_int_attribute(linearAttribute, 0);
+
+            auto progress = std::make_shared<DecodeProgress>();
+            {
+                std::lock_guard<std::mutex> lock(decodeMutex);
+                streamedNode = node;
+                streamProgress = progress;
+            }
+
+            bool success = streamImageToDevice(
+                        *cpuImage, colorSpace, tmpCacheImage.get(), applyColorSpace, progress.get());
+
+            {
+                std::lock_guard<std::mutex> lock(decodeMutex);
+                streamedNode = nullptr;
+                streamProgress = nullptr;
+            }
+
+            cpuImage = nullptr;
+
+            // The evaluation was cancelled, what was streamed so far is of no use
+            if (progress->cancelled)
+            {
+                retireImage(node->setSourceImage(nullptr));
+                retireImage(node->setCachedImage(nullptr));
+                return false;
+            }
+
+            if (!success)
+                CS_LOG_WARNING("Failed to stream image to the device.");
+
+            computeCommandBuffer->recordImageLoad(
+                        nullptr,
+                        tmpCacheImage.get(),
+                        computeRenderTarget.get(),
+                        &pipelines[NODE_TYPE_READ].get());
+        }
+        else
+        {
+            // The render target stands in for the input image, the pixels come from sourceBuffer
+            updateComputeDescriptors(computeRenderTarget.get(), nullptr, computeRenderTarget.get());
+
+            float settings[] = {
+                static_cast<float>(getSourceType(cpuImage->spec().format)),
+                static_cast<float>(cpuImage->nchannels())
+            };
+            settingsBuffer->fillBuffer(settings, 2);
+
+            computeCommandBuffer->recordImageLoad(
+                        nullptr,
+                        computeRenderTarget.get(),
+                        computeRenderTarget.get(),
+                        &readBufferPipeline.get());
+        }
 
         computeCommandBuffer->submitImageLoad();
 
-        node->setCachedImage(std::move(computeRenderTarget));
+        if (transformLoadOnDevice)
+        {
+            auto linearImage = std::unique_ptr<CsImage>(
+                        new CsImage(window,
+                                    &device,
+                                    &physicalDevice,
+                                    computeRenderTarget->getWidth(),
+                                    computeRenderTarget->getHeight(),
+                                    false,
+                                    "Linear Image"));
+
+            if (transformColorSpaceOnDevice(
+                        colorSpaces.at(colorSpace),
+                        "linear",
+                        computeRenderTarget.get(),
+                        linearImage.get()))
+            {
+                computeRenderTarget = std::move(linearImage);
+            }
+        }
+
+        retireImage(node->setSourceImage(std::move(computeRenderTarget)));
 
-        // Delete the staging image
-        auto result = device.waitIdle();
+        auto result = computeCommandBuffer->getQueue()->waitIdle();
         Q_UNUSED(result);
 
-        loadImageStaging = nullptr;
+        // The buffer belongs to cpuImage, which might leave the cache
+        sourceBuffer = emptySourceBuffer;
+
+        createProxyImage(node, renderScale);
     }
     else
     {
-        node->flushCache();
+        retireImage(node->setSourceImage(nullptr));
+        retireImage(node->setCachedImage(nullptr));
+    }
+
+    return true;
+}
+
+void VulkanRenderer::createProxyImage(NodeBase *node, const int renderScale)
+{
+    if (renderScale == 1)
+    {
+        // Full resolution falls back to the source image
+        retireImage(node->setCachedImage(nullptr));
+        return;
     }
+
+    auto source = node->getSourceImage();
+
+    int width = std::max(source->getWidth() / renderScale, 1);
+    int height = std::max(source->getHeight() / renderScale, 1);
+
+    // Target width, target height, link, bilinear
+    const float settings[] = {
+        static_cast<float>(width),
+        static_cast<float>(height),
+        0.0f,
+        2.0f
+    };
+    settingsBuffer->fillBuffer(settings, 4);
+
+    if (!createComputeRenderTarget(width, height))
+        CS_LOG_WARNING("Failed to create compute render target.");
+
+    updateComputeDescriptors(source, nullptr, computeRenderTarget.get());
+
+    computeCommandBuffer->recordGeneric(
+                source,
+                nullptr,
+                computeRenderTarget.get(),
+                pipelines[NODE_TYPE_RESIZE].get(),
+                1,
+                1);
+
+    computeCommandBuffer->submitGeneric();
+
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
+
+    retireImage(node->setCachedImage(std::move(computeRenderTarget)));
 }
 
 void VulkanRenderer::processNode(
         NodeBase* node,
         CsImage* inputImageBack,
         CsImage* inputImageFront,
-        const QSize targetSize)
+        const QSize targetSize,
+        const int renderScale)
 {
-    auto result = device.waitIdle();
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
 
-    fillSettingsBuffer(node);
+    fillSettingsBuffer(node, renderScale);
 
     if (!createComputeRenderTarget(targetSize.width(), targetSize.height()))
         CS_LOG_WARNING("Failed to create compute render target.");
@@ -1104,9 +2344,9 @@ void VulkanRenderer::processNode(
 
     if (node->nodeType == NODE_TYPE_SHADER || node->nodeType == NODE_TYPE_ISF)
     {
-        if (node->getShaderCode().size() != 0)
+        if (node->getShaderCodeSnapshot().size() != 0)
         {
-            shaderUser = createShaderFromCode(node->getShaderCode());
+            shaderUser = createShaderFromCode(node->getShaderCodeSnapshot());
 
             computePipelineUser = createComputePipeline(shaderUser.get());
 
@@ -1135,11 +2375,9 @@ void VulkanRenderer::processNode(
 
         computeCommandBuffer->submitGeneric();
 
-        window->requestUpdate();
-
-        result = device.waitIdle();
+        result = computeCommandBuffer->getQueue()->waitIdle();
 
-        node->setCachedImage(std::move(computeRenderTarget));
+        retireImage(node->setCachedImage(std::move(computeRenderTarget)));
     }
     else
     {
@@ -1185,27 +2423,89 @@ void VulkanRenderer::processNode(
             }
             currentShaderPass++;
 
-            result = device.waitIdle();
+            result = computeCommandBuffer->getQueue()->waitIdle();
 
-            node->setCachedImage(std::move(computeRenderTarget));
+            retireImage(node->setCachedImage(std::move(computeRenderTarget)));
         }
+    }
+}
 
-        window->requestUpdate();
+bool VulkanRenderer::canFuseNodes(const std::vector<NodeType>& types) const
+{
+    return shaderFuser.canFuse(types);
+}
+
+bool VulkanRenderer::processFusedNodes(
+        const std::vector<NodeBase*>& nodes,
+        CsImage* inputImage,
+        const QSize targetSize,
+        const int renderScale)
+{
+    std::vector<NodeType> types;
+    std::vector<float> values;
+
+    for (auto node : nodes)
+    {
+        types.push_back(node->nodeType);
+
+        // Every stage reads as many values as its own shader declares,
+        // useMask included. The snapshot lacks the flag processNode
+        // appends, so it is padded with 0, fused nodes have no mask.
+        auto nodeValues = getScaledParameters(node, renderScale);
+        nodeValues.resize(shaderFuser.getParameterCount(node->nodeType), 0.0f);
+        values.insert(values.end(), nodeValues.begin(), nodeValues.end());
+    }
+
+    auto& fusedPipeline = fusedPipelines[types];
+    if (!fusedPipeline)
+    {
+        auto& code = shaderFuser.getFusedShader(types);
+        if (code.empty())
+            return false;
+
+        fusedPipeline = createComputePipeline(createShaderFromCode(code).get());
     }
+    auto pipeline = fusedPipeline.get();
+
+    auto result = computeCommandBuffer->getQueue()->waitIdle();
+
+    settingsBuffer->fillBuffer(values.data(), values.size());
+
+    if (!createComputeRenderTarget(targetSize.width(), targetSize.height()))
+        CS_LOG_WARNING("Failed to create compute render target.");
+
+    updateComputeDescriptors(inputImage, nullptr, computeRenderTarget.get());
+
+    computeCommandBuffer->recordGeneric(
+                inputImage,
+                nullptr,
+                computeRenderTarget.get(),
+                pipeline,
+                1,
+                1);
+
+    computeCommandBuffer->submitGeneric();
+
+    result = computeCommandBuffer->getQueue()->waitIdle();
+    Q_UNUSED(result);
+
+    retireImage(nodes.back()->setCachedImage(std::move(computeRenderTarget)));
+
+    return true;
 }
 
 void VulkanRenderer::displayNode(const NodeBase *node)
 {
     if(CsImage* image = node->getCachedImage())
     {
-        // Execute a NoOp shader on the node
         clearScreen = false;
 
-        updateVertexData(image->getWidth(), image->getHeight());
-        createVertexBuffer();
+        // Proxies are displayed at the size of the full resolution image
+        outputImageSize = QSize(
+                    image->getWidth() * node->cachedImageScale,
+                    image->getHeight() * node->cachedImageScale);
 
-        if (!createComputeRenderTarget(image->getWidth(), image->getHeight()))
-            CS_LOG_WARNING("Failed to create compute render target.");
+        emit window->renderTargetHasBeenCreated(image->getWidth(), image->getHeight());
 
         CsImage* upstreamImage = nullptr;
         if (node->getUpstreamNodeBack())
@@ -1213,18 +2513,23 @@ void VulkanRenderer::displayNode(const NodeBase *node)
         if (!upstreamImage)
             upstreamImage = image;
 
-        updateGraphicsDescriptors(image, upstreamImage);
-        updateComputeDescriptors(image, nullptr, computeRenderTarget.get());
+        // Descriptor sets might still be used by a frame in flight
+        vk::Queue graphicsQueue(window->graphicsQueue());
+        auto result = graphicsQueue.waitIdle();
+        Q_UNUSED(result);
 
-        computeCommandBuffer->recordGeneric(
-                    image,
-                    nullptr,
-                    computeRenderTarget.get(),
-                    *computePipelineNoop,
-                    1,
-                    1);
+        // The graphics pass samples the cached image, or a
+        // mipmapped copy of it if the device is able to blit
+        auto viewedImage = createViewerMipmaps(image);
+        updateGraphicsDescriptors(viewedImage, upstreamImage);
 
-        computeCommandBuffer->submitGeneric();
+        {
+            std::lock_guard<std::mutex> lock(retiredImagesMutex);
+            boundImages = { viewedImage, upstreamImage };
+        }
+
+        // Nothing refers to replaced images anymore
+        releaseRetiredImages();
 
         window->requestUpdate();
     }
@@ -1235,6 +2540,111 @@ void VulkanRenderer::displayNode(const NodeBase *node)
     }
 }
 
+CsImage* VulkanRenderer::createViewerMipmaps(CsImage* const image)
+{
+    if (!canBlitMipmaps)
+        return image;
+
+    const int w = image->getWidth();
+    const int h = image->getHeight();
+    const uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
+
+    // Only allocate again if the size of the viewed image changed
+    if (!viewerImage || viewerImage->getWidth() != w || viewerImage->getHeight() != h)
+    {
+        viewerImage = nullptr;
+        viewerImage = std::unique_ptr<CsImage>(
+                    new CsImage(window,
+                                &device,
+                                &physicalDevice,
+                                w,
+                                h,
+                                false,
+                                "Viewer Image",
+                                levels));
+    }
+
+    auto& cb = viewerCommandBuffer;
+
+    vk::CommandBufferBeginInfo beginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    auto result = cb->begin(beginInfo);
+
+    image->transitionLayoutTo(cb, vk::ImageLayout::eTransferSrcOptimal);
+    viewerImage->transitionLayoutTo(cb, vk::ImageLayout::eTransferDstOptimal);
+
+    auto barrier = [&](uint32_t level, vk::ImageLayout from, vk::ImageLayout to)
+    {
+        vk::ImageMemoryBarrier b(
+                    vk::AccessFlagBits::eTransferWrite,
+                    vk::AccessFlagBits::eTransferRead,
+                    from,
+                    to,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED,
+                    *viewerImage->getImage(),
+                    { vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 });
+        cb->pipelineBarrier(
+                    vk::PipelineStageFlagBits::eTransfer,
+                    vk::PipelineStageFlagBits::eTransfer,
+                    {}, {}, {}, b);
+    };
+
+    // Level 0 is a straight copy, every following level is
+    // a half size blit of the one above it
+    int srcW = w;
+    int srcH = h;
+    for (uint32_t level = 0; level < levels; ++level)
+    {
+        int dstW = std::max(srcW / 2, 1);
+        int dstH = std::max(srcH / 2, 1);
+
+        vk::ImageBlit blit;
+        if (level == 0)
+        {
+            blit.srcSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+            blit.srcOffsets[1] = vk::Offset3D(w, h, 1);
+            blit.dstOffsets[1] = vk::Offset3D(w, h, 1);
+        }
+        else
+        {
+            blit.srcSubresource = { vk::ImageAspectFlagBits::eColor, level - 1, 0, 1 };
+            blit.srcOffsets[1] = vk::Offset3D(srcW, srcH, 1);
+            blit.dstOffsets[1] = vk::Offset3D(dstW, dstH, 1);
+            srcW = dstW;
+            srcH = dstH;
+        }
+        blit.dstSubresource = { vk::ImageAspectFlagBits::eColor, level, 0, 1 };
+
+        cb->blitImage(
+                    level == 0 ? *image->getImage() : *viewerImage->getImage(),
+                    vk::ImageLayout::eTransferSrcOptimal,
+                    *viewerImage->getImage(),
+                    vk::ImageLayout::eTransferDstOptimal,
+                    blit,
+                    canFilterLinear ? vk::Filter::eLinear : vk::Filter::eNearest);
+
+        barrier(level, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal);
+    }
+
+    // All levels are in transfer source layout now
+    viewerImage->setLayout(vk::ImageLayout::eTransferSrcOptimal);
+    viewerImage->transitionLayoutTo(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
+    image->transitionLayoutTo(cb, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    result = cb->end();
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cb.get();
+
+    vk::Queue queue(window->graphicsQueue());
+    result = queue.submit(1, &submitInfo, {});
+    result = queue.waitIdle();
+    Q_UNUSED(result);
+
+    return viewerImage.get();
+}
+
 void VulkanRenderer::doClearScreen()
 {
     clearScreen = true;
@@ -1242,6 +2652,31 @@ void VulkanRenderer::doClearScreen()
     window->requestUpdate();
 }
 
+void VulkanRenderer::retireImage(std::unique_ptr<CsImage> image)
+{
+    if (!image)
+        return;
+
+    // Replaced images can still be bound to the viewer, so
+    // they are destroyed on the GUI thread once it moved on
+    std::lock_guard<std::mutex> lock(retiredImagesMutex);
+    retiredImages.push_back(std::move(image));
+}
+
+void VulkanRenderer::releaseRetiredImages()
+{
+    std::lock_guard<std::mutex> lock(retiredImagesMutex);
+
+    // Images the viewer still samples are kept until it moved on
+    std::vector<std::unique_ptr<CsImage>> boundRetiredImages;
+    for (auto& image : retiredImages)
+    {
+        if (std::find(boundImages.begin(), boundImages.end(), image.get()) != boundImages.end())
+            boundRetiredImages.push_back(std::move(image));
+    }
+    retiredImages = std::move(boundRetiredImages);
+}
+
 void VulkanRenderer::startNextFrame()
 {
     if (clearScreen)
@@ -1313,15 +2748,38 @@ void VulkanRenderer::releaseResources()
 void VulkanRenderer::shutdown()
 {
     CS_LOG_INFO("Destroying Renderer.");
+    finishDecoding();
+
+    CS_LOG_INFO("Color processor hits: " + QString::number(colorProcessors.getHits()) +
+                ", misses: " + QString::number(colorProcessors.getMisses()) +
+                ", created in " + QString::number(colorProcessors.getBuildMilliseconds(), 'f', 2) +
+                "[milliseconds]");
+
+    cpuImage = nullptr;
+    decodedImages.clear();
+    if (imageCache)
+    {
+        OIIO::ImageCache::destroy(imageCache);
+        imageCache = nullptr;
+    }
     auto result = device.waitIdle();
 
 
     loadImageStaging = nullptr;
     tmpCacheImage = nullptr;
     computeRenderTarget = nullptr;
+    viewerImage = nullptr;
+    viewerCommandBuffer = {};
+    boundImages = {};
+    releaseRetiredImages();
     settingsBuffer = nullptr;
     for(auto& pl : pipelines)
         device.destroy(*pl.second);
+    fusedPipelines.clear();
+    deviceColorTransforms.clear();
+    readBufferPipeline = {};
+    sourceBuffer = nullptr;
+    emptySourceBuffer = nullptr;
     device.destroy(*computePipelineNoop);
     device.destroy(*computePipelineUser);
     device.destroy(*graphicsPipelineRGB);
@@ -21,12 +21,16 @@
 #define VULKANRENDERER_H
 
 #include <array>
+#include <atomic>
+#include <future>
+#include <mutex>
 
 #include <QVulkanWindow>
 #include <QImage>
 
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/imagecache.h>
 #include <OpenImageIO/color.h>
 #include <OpenColorIO/OpenColorIO.h>
 
@@ -35,8 +39,13 @@
 #include "../nodebase.h"
 #include "../windowmanager.h"
 #include "cssettingsbuffer.h"
+#include "csuploadbuffer.h"
 #include "csimage.h"
+#include "colorprocessorcache.h"
+#include "colortransformshaders.h"
 #include "cscommandbuffer.h"
+#include "decodedimagecache.h"
+#include "shaderfuser.h"
 
 namespace OCIO = OCIO_NAMESPACE;
 
@@ -57,21 +66,79 @@ public:
     void releaseSwapChainResources() override;
     void releaseResources() override;
 
-    void processReadNode(
-            NodeBase* node);
+    // False if streaming the file was cancelled, the
+    // node has no image then and decodes it again
+    bool processReadNode(
+            NodeBase* node,
+            const bool needsDecode,
+            const int renderScale = 1);
+    // Decodes the files of Read nodes on the TBB pool,
+    // processReadNode() picks up the results. A decode that is
+    // running for another file of the same node is cancelled.
+    void startDecoding(
+            const std::vector<NodeBase*>& nodes);
+    bool isDecoding(
+            const NodeBase* node);
+    // Between 0 and 1, or -1 if nothing is decoded for the node
+    float getDecodeProgress(
+            const NodeBase* node);
+    void cancelDecoding(
+            const NodeBase* node);
+    // Stops a file that is streamed to the device at the next band
+    void cancelStreaming();
+    // Finished decodes of nodes that are not evaluated anymore
+    // go to the decoded image cache instead of staying pinned
+    void releaseDecodes(
+            const std::vector<NodeBase*>& evaluatedNodes);
+    void finishDecoding();
+    // Host memory decoded files may take up, larger files are streamed
+    void setImageCacheSize(const int megabytes);
+    // Decodes a file a Read node is going to show next, as long
+    // as the prefetched images stay within the budget
+    void prefetchImage(
+            const QString& path,
+            const int colorSpace);
+    void clearPrefetchedImages();
+    void setPrefetchBudget(const int megabytes);
+    int getPrefetchHits() const;
+    int getPrefetchMisses() const;
+    // Files a Read node showed before stay decoded up to this size
+    void setDecodedImageCacheSize(const int megabytes);
     void processNode(
             NodeBase* node,
             CsImage* inputImageBack,
             CsImage* inputImageFront,
-            const QSize targetSize);
+            const QSize targetSize,
+            const int renderScale = 1);
+    // Runs a chain of per-pixel nodes as one shader,
+    // only the last node gets an image
+    bool canFuseNodes(
+            const std::vector<NodeType>& types) const;
+    bool processFusedNodes(
+            const std::vector<NodeBase*>& nodes,
+            CsImage* inputImage,
+            const QSize targetSize,
+            const int renderScale = 1);
+    // Copies between device images and host memory
+    std::unique_ptr<CsImage> uploadImage(
+            float* pixels,
+            const int width,
+            const int height);
+    std::vector<float> downloadImage(
+            CsImage* const image);
     bool saveImageToDisk(
             CsImage* const inputImage,
             const QString& path,
             const QMap<std::string, std::string>& attributes,
             const int colorSpace);
+    // Saves reuse their readback memory until it is released
+    void releaseImageSaveBuffer();
     void displayNode(
             const NodeBase* node);
     void doClearScreen();
+    void retireImage(
+            std::unique_ptr<CsImage> image);
+    void releaseRetiredImages();
     void setDisplayMode(
             const DisplayMode mode);
 
@@ -80,6 +147,9 @@ public:
     void startNextFrame() override;
 
     QString getGpuName();
+    bool canRenderConcurrently();
+    // How much device memory node images may use
+    vk::DeviceSize getDeviceMemoryBudget();
 
     void translate(float dx, float dy);
     void scale(float s);
@@ -92,6 +162,7 @@ private:
     // Initialize
     void createVertexBuffer();
     void createSampler();
+    void createViewerCommandBuffer();
     void createDescriptorPool();
     void createGraphicsDescriptors();
     void createGraphicsPipelineCache();
@@ -105,13 +176,69 @@ private:
     vk::UniquePipeline createComputePipeline(const vk::ShaderModule& shaderModule);
 
     // Load image
+    bool getReadNodeFile(
+            const NodeBase* node,
+            QString& path,
+            int& colorSpace) const;
+    struct DecodeProgress;
+    std::shared_ptr<ImageBuf> decodeImage(
+            const QString& path,
+            const int colorSpace,
+            DecodeProgress* progress = nullptr);
+    std::shared_ptr<ImageBuf> decodeIntoUploadBuffer(
+            const QString& path,
+            const int colorSpace,
+            OIIO::ProgressCallback callback,
+            DecodeProgress* progress);
+    // Key of a file in decodedImages, in the layout a decode
+    // would leave it in. Opens the file if no spec is given.
+    QByteArray getDecodedImageKey(
+            const QString& path,
+            const int colorSpace,
+            const OIIO::ImageSpec& fileSpec);
+    QByteArray getDecodedImageKey(
+            const QString& path,
+            const int colorSpace);
+    // Key of an image that was decoded already
+    QByteArray getStoredImageKey(
+            const QString& path,
+            const int colorSpace,
+            const ImageBuf& image) const;
+    bool hasDecodeJob(
+            const NodeBase* node);
+    bool isStreamed(
+            const OIIO::ImageSpec& spec) const;
+    // Turns a prefetched file into the decode of a node,
+    // decodeMutex has to be locked
+    bool takePrefetchJob(
+            const NodeBase* node,
+            const QString& path,
+            const int colorSpace);
+    std::shared_ptr<ImageBuf> takePrefetchedImage(
+            const QString& path,
+            const int colorSpace);
+    bool streamImageToDevice(
+            ImageBuf& image,
+            const int colorSpace,
+            CsImage* const target,
+            const bool applyColorSpace,
+            DecodeProgress* progress);
+    std::shared_ptr<ImageBuf> takeDecodedImage(
+            const NodeBase* node,
+            const QString& path,
+            const int colorSpace);
     bool createImageFromFile(
+            const NodeBase* node,
             const QString &path,
             const int colorSpace);
+    void createReadBufferPipeline();
     bool writeLinearImage(
             float* imgStart,
             QSize imgSize,
             std::unique_ptr<CsImage>& image);
+    void createProxyImage(
+            NodeBase* node,
+            const int renderScale);
 
     // Compute setup
     void createComputePipelineLayout();
@@ -131,6 +258,8 @@ private:
     void updateGraphicsDescriptors(
             const CsImage* const outputImage,
             const CsImage* const upstreamImage);
+    CsImage* createViewerMipmaps(
+            CsImage* const image);
     void updateComputeDescriptors(
             const CsImage* const inputImageBack,
             const CsImage* const inputImageFront,
@@ -139,17 +268,26 @@ private:
     // Has to be called in startNextFrame()
     void createRenderPass();
 
-    void updateVertexData(
-            const int w,
-            const int h);
-
     void transformColorSpace(
             const QString& from,
             const QString& to,
             ImageBuf& image);
+    // False if the conversion has to run on the CPU
+    bool prepareDeviceColorTransform(
+            const QString& from,
+            const QString& to);
+    bool transformColorSpaceOnDevice(
+            const QString& from,
+            const QString& to,
+            CsImage* const inputImage,
+            CsImage* const outputImage);
 
+    std::vector<float> getScaledParameters(
+            const NodeBase* node,
+            const int renderScale = 1);
     void fillSettingsBuffer(
-            const NodeBase* node);
+            const NodeBase* node,
+            const int renderScale = 1);
 
     void logicalDeviceLost() override;
 
@@ -172,6 +310,12 @@ private:
     vk::UniqueQueryPool queryPool;
 
     vk::UniqueSampler sampler;
+    bool canFilterLinear = false;
+    bool canBlitMipmaps = false;
+
+    // Copy of the displayed image with a full mip chain
+    std::unique_ptr<CsImage> viewerImage;
+    vk::UniqueCommandBuffer viewerCommandBuffer;
 
     vk::UniquePipeline computePipelineNoop;
     vk::UniqueShaderModule shaderUser;
@@ -179,11 +323,66 @@ private:
 
     QSize currentRenderSize;
 
-    std::unique_ptr<ImageBuf> cpuImage;
+    // Might be shared with decodedImages
+    std::shared_ptr<ImageBuf> cpuImage;
+    // Colors of cpuImage are converted after it is uploaded
+    bool transformLoadOnDevice = false;
+
+    // Pixels of cpuImage for readbuffer.comp, the empty
+    // buffer keeps the descriptor valid between loads
+    std::shared_ptr<CsUploadBuffer> sourceBuffer;
+    std::shared_ptr<CsUploadBuffer> emptySourceBuffer;
+    vk::DeviceSize maxSourceBufferRange = 0;
+    vk::UniquePipeline readBufferPipeline;
     QString imagePath;
 
+    // Shared between a decode and the threads asking about it
+    struct DecodeProgress
+    {
+        std::atomic<bool> cancelled = false;
+        std::atomic<float> done = 0.0f;
+    };
+    struct DecodeJob
+    {
+        QString path;
+        int colorSpace;
+        std::shared_ptr<DecodeProgress> progress;
+        std::future<std::shared_ptr<ImageBuf>> image;
+    };
+    // Decodes are kept until their node is rendered, no matter
+    // how many evaluations that takes, or it is not viewed anymore
+    std::map<const NodeBase*, DecodeJob> decodeJobs;
+    // Large files are streamed band by band during the evaluation
+    const NodeBase* streamedNode = nullptr;
+    std::shared_ptr<DecodeProgress> streamProgress;
+    // Cancelled decodes might still be running
+    std::vector<std::future<std::shared_ptr<ImageBuf>>> cancelledDecodes;
+    std::mutex decodeMutex;
+
+    struct PrefetchJob
+    {
+        std::shared_ptr<DecodeProgress> progress;
+        // Taken from prefetchedBytes once the size is known
+        std::shared_ptr<size_t> bytes;
+        std::future<std::shared_ptr<ImageBuf>> image;
+    };
+    // Guarded by decodeMutex as well
+    std::map<std::pair<QString, int>, PrefetchJob> prefetchJobs;
+    size_t prefetchedBytes = 0;
+    size_t prefetchBudget = size_t(2048) * 1024 * 1024;
+    // Counted on the render thread, read on the GUI thread
+    std::atomic<int> prefetchHits = 0;
+    std::atomic<int> prefetchMisses = 0;
+
+    DecodedImageCache decodedImages;
+
+    // Tiles of the files that are streamed to the device
+    OIIO::ImageCache* imageCache = nullptr;
+    size_t imageCacheSize = size_t(1024) * 1024 * 1024;
+
     int concurrentFrameCount;  
 
+    // Full resolution size of the displayed image
     QSize outputImageSize;
 
     QMatrix4x4 projection;
@@ -209,9 +408,26 @@ private:
     std::unique_ptr<CsImage>                tmpCacheImage;
     std::unique_ptr<CsImage>                computeRenderTarget;
 
+    std::vector<std::unique_ptr<CsImage>>   retiredImages;
+    std::mutex                              retiredImagesMutex;
+    // What the graphics descriptors point to right now
+    std::array<const CsImage*, 2>           boundImages = {};
+
     std::map<NodeType, vk::UniqueShaderModule>  shaders;
     std::map<NodeType, vk::UniquePipeline>      pipelines;
 
+    ShaderFuser                                             shaderFuser;
+    std::map<std::vector<NodeType>, vk::UniquePipeline>     fusedPipelines;
+
+    struct DeviceColorTransform
+    {
+        vk::UniquePipeline pipeline;
+        std::unique_ptr<CsImage> lut;
+    };
+    ColorProcessorCache                                     colorProcessors;
+    ColorTransformShaders                                   colorTransformShaders;
+    std::map<std::pair<QString, QString>, DeviceColorTransform> deviceColorTransforms;
+
     // TODO: Move this out of here
     std::vector<float> viewerPushConstants = { 0.0f, 0.5f, 0.0f, 1.0f, 1.0f };
 
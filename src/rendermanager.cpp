@@ -19,12 +19,22 @@
 
 #include "rendermanager.h"
 
+#include <algorithm>
+#include <unordered_set>
+
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QSet>
 
 #include "uientities/uientity.h"
 #include "uientities/fileboxentity.h"
 #include "renderer/vulkanrenderer.h"
 #include "popupmessages.h"
+#include "preferencesmanager.h"
 
 namespace Cascade {
 
@@ -41,6 +51,58 @@ void RenderManager::setUp(VulkanRenderer *r, NodeGraph* ng)
     nodeGraph = ng;
 
     wManager = &WindowManager::getInstance();
+
+    // Full resolution refine once the user stopped changing things
+    refineTimer.setSingleShot(true);
+    refineTimer.setInterval(300);
+    connect(&refineTimer, &QTimer::timeout,
+            this, &RenderManager::handleRefineTimeout);
+
+    displayTimer.setSingleShot(true);
+    connect(&displayTimer, &QTimer::timeout,
+            this, &RenderManager::handleDisplayTimeout);
+
+    lastEvaluation.start();
+
+    decodeTimer.setInterval(100);
+    connect(&decodeTimer, &QTimer::timeout,
+            this, &RenderManager::handleDecodeTimeout);
+
+    auto prefs = &PreferencesManager::getInstance();
+    spillCache.setUp(
+                size_t(prefs->getHostSpillBudget()) * 1024 * 1024,
+                size_t(prefs->getSpillDiskBudget()) * 1024 * 1024,
+                prefs->getSpillDirectory());
+    renderer->setImageCacheSize(prefs->getImageCacheSize());
+    renderer->setPrefetchBudget(prefs->getPrefetchBudget());
+    renderer->setDecodedImageCacheSize(prefs->getDecodedImageCacheSize());
+
+    connect(this, &RenderManager::evaluationFinished,
+            this, &RenderManager::handleEvaluationFinished,
+            Qt::QueuedConnection);
+
+    renderContext.moveToThread(&renderThread);
+    renderThread.start();
+}
+
+void RenderManager::shutdown()
+{
+    waitForEvaluation();
+    decodeTimer.stop();
+
+    renderThread.quit();
+    renderThread.wait();
+
+    CS_LOG_INFO("Result cache hits: " + QString::number(resultCache.getHits()) +
+                ", misses: " + QString::number(resultCache.getMisses()));
+
+    resultCache.clear();
+    spillCache.clear();
+}
+
+const Renderer::ResultCache& RenderManager::getResultCache() const
+{
+    return resultCache;
 }
 
 void RenderManager::updateViewerPushConstants(const QString &s)
@@ -48,14 +110,94 @@ void RenderManager::updateViewerPushConstants(const QString &s)
     renderer->setViewerPushConstants(s);
 }
 
+void RenderManager::setProxyScale(const int s)
+{
+    proxyScale = std::max(s, 1);
+
+    if (proxyScale == 1)
+        handleRefineTimeout();
+}
+
+void RenderManager::setViewerZoom(const float z)
+{
+    viewerZoom = z;
+
+    // Zooming in past the resolution on screen needs a finer render,
+    // zooming out keeps showing the finer image we already have
+    if (lastDisplayRequest && getDisplayScale() < renderScale)
+        refineTimer.start();
+}
+
+int RenderManager::getDisplayScale() const
+{
+    // Largest power of two the image can be reduced by
+    // without the viewer showing fewer pixels than it could
+    int scale = 1;
+    while (scale < 8 && viewerZoom * scale * 2 <= 1.0f)
+        scale *= 2;
+
+    return scale;
+}
+
 void RenderManager::handleNodeDisplayRequest(NodeBase* node)
 {
+    // Only remember the latest request, everything that comes in
+    // before the next evaluation starts is superseded by it
+    pendingDisplayRequest = node;
+
+    if (displayTimer.isActive())
+        return;
+
+    int frameTime = 16;
+    auto screen = QGuiApplication::primaryScreen();
+    if (screen && screen->refreshRate() > 0)
+        frameTime = static_cast<int>(1000.0 / screen->refreshRate());
+
+    displayTimer.start(std::max(frameTime - static_cast<int>(lastEvaluation.elapsed()), 0));
+}
+
+void RenderManager::handleDisplayTimeout()
+{
+    if (!pendingDisplayRequest)
+        return;
+
+    // The running evaluation is cancelled at the next node,
+    // this request is picked up again once it has finished
+    if (isEvaluating)
+    {
+        cancelEvaluation();
+        return;
+    }
+
+    NodeBase* node = pendingDisplayRequest;
+    pendingDisplayRequest = nullptr;
+
+    processDisplayRequest(node);
+
+    lastEvaluation.restart();
+}
+
+void RenderManager::processDisplayRequest(NodeBase* node)
+{
+    lastDisplayRequest = node;
+
+    // Never compute more pixels than the viewer is able to show
+    int displayScale = getDisplayScale();
+
+    // While the graph keeps changing we render a proxy and
+    // queue a full resolution refine for when input goes idle
+    renderScale = displayScale;
+    if (proxyScale > displayScale && !isRefining &&
+        (refineTimer.isActive() || hasPendingUpdates(node)))
+    {
+        renderScale = proxyScale;
+        refineTimer.start();
+    }
+
     auto props = getPropertiesForType(node->nodeType);
 
     auto viewerMode = wManager->getViewerMode();
 
-    renderer->setDisplayMode(DISPLAY_MODE_RGB);
-
     if (viewerMode == VIEWER_MODE_FRONT_RGB)
     {
         if (props.frontInputTrait == FRONT_INPUT_ALWAYS_CLEAR)
@@ -64,7 +206,7 @@ void RenderManager::handleNodeDisplayRequest(NodeBase* node)
         }
         else if (props.frontInputTrait == FRONT_INPUT_RENDER_UPSTREAM_OR_CLEAR)
         {
-            displayNode(node->getUpstreamNodeFront());
+            startEvaluation(node->getUpstreamNodeFront(), DISPLAY_MODE_RGB);
         }
     }
     else if (viewerMode == VIEWER_MODE_BACK_RGB)
@@ -75,7 +217,7 @@ void RenderManager::handleNodeDisplayRequest(NodeBase* node)
         }
         else if (props.backInputTrait == BACK_INPUT_RENDER_UPSTREAM_OR_CLEAR)
         {
-            displayNode(node->getUpstreamNodeBack());
+            startEvaluation(node->getUpstreamNodeBack(), DISPLAY_MODE_RGB);
         }
     }
     else if (viewerMode == VIEWER_MODE_INPUT_ALPHA)
@@ -86,17 +228,17 @@ void RenderManager::handleNodeDisplayRequest(NodeBase* node)
         }
         else if (props.alphaInputTrait == ALPHA_INPUT_RENDER_UPSTREAM_OR_CLEAR)
         {
-            renderer->setDisplayMode(DISPLAY_MODE_ALPHA);
-            displayNode(node->getUpstreamNodeFront());
+            startEvaluation(node->getUpstreamNodeFront(), DISPLAY_MODE_ALPHA);
         }
     }
     else if (viewerMode == VIEWER_MODE_OUTPUT_RGB || viewerMode == VIEWER_MODE_OUTPUT_ALPHA)
     {
         NodeBase* nodeToDisplay = node;
 
+        DisplayMode mode = DISPLAY_MODE_RGB;
         if (viewerMode == VIEWER_MODE_OUTPUT_ALPHA)
         {
-            renderer->setDisplayMode(DISPLAY_MODE_ALPHA);
+            mode = DISPLAY_MODE_ALPHA;
         }
         if (props.rgbOutputTrait == OUTPUT_RENDER_UPSTREAM_IF_FRONT_DISCONNECTED)
         {
@@ -108,7 +250,7 @@ void RenderManager::handleNodeDisplayRequest(NodeBase* node)
                 }
             }
         }
-        displayNode(nodeToDisplay);
+        startEvaluation(nodeToDisplay, mode);
     }
 }
 
@@ -122,6 +264,17 @@ void RenderManager::handleNodeFileSaveRequest(
     if (node->canBeRendered())
     {
         auto upstream = node->getUpstreamNodeBack();
+
+        // Saving renders on this thread, the render thread has to be idle
+        waitForEvaluation();
+
+        // The next files are decoded while this one renders and saves
+        if (isBatch)
+            prefetchBatchImages(upstream);
+
+        // The viewer might be showing a proxy, files are always full resolution
+        renderNodes(upstream, 1);
+
         auto image = upstream->getCachedImage();
         if(image)
         {
@@ -150,77 +303,914 @@ void RenderManager::handleNodeFileSaveRequest(
             }
         }
     }
+
+    if (isBatch && isLast)
+    {
+        int hits = renderer->getPrefetchHits();
+        int lookups = hits + renderer->getPrefetchMisses();
+        if (lookups > 0)
+        {
+            CS_LOG_INFO("Prefetch hits: " + QString::number(hits) +
+                        " of " + QString::number(lookups) +
+                        " (" + QString::number(100 * hits / lookups) + "%)");
+        }
+        renderer->clearPrefetchedImages();
+    }
+
+    // Only the next file of a batch needs the readback memory
+    if (!isBatch || isLast)
+        renderer->releaseImageSaveBuffer();
+}
+
+void RenderManager::prefetchBatchImages(NodeBase* node)
+{
+    std::vector<NodeBase*> nodes;
+    node->getAllUpstreamNodes(nodes);
+
+    foreach (NodeBase* n, nodes)
+    {
+        if (n->nodeType != NODE_TYPE_READ)
+            continue;
+
+        // The batch moved on to the next file since the last
+        // evaluation, so the snapshot is taken before it renders
+        n->takeParameterSnapshot();
+
+        // Same layout as in VulkanRenderer::getReadNodeFile,
+        // the files, the current one and the color space
+        const auto& params = n->getParameterSnapshot();
+        if (params.values.size() < 3)
+            continue;
+
+        const int numFiles = static_cast<int>(params.values.size()) - 2;
+        const int current = std::max(static_cast<int>(params.values[numFiles]), 0);
+        const int colorSpace = static_cast<int>(params.values.back());
+
+        for (int i = current + 1; i <= current + Renderer::batchPrefetchCount && i < numFiles; ++i)
+        {
+            QString path = params.text.value(i);
+            if (!path.isEmpty())
+                renderer->prefetchImage(path, colorSpace);
+        }
+    }
 }
 
 void RenderManager::handleClearScreenRequest()
 {
+    refineTimer.stop();
+    displayTimer.stop();
+    lastDisplayRequest = nullptr;
+    pendingDisplayRequest = nullptr;
+
+    // Don't show the result of a running evaluation
+    cancelEvaluation();
+    evaluatedNode = nullptr;
+
     renderer->doClearScreen();
 }
 
-void RenderManager::displayNode(NodeBase* node)
+void RenderManager::handleDecodeTimeout()
 {
-    if (node && node->canBeRendered())
+    bool hasDecodedImages = false;
+
+    for (auto it = decodingNodes.begin(); it != decodingNodes.end();)
+    {
+        NodeBase* node = *it;
+        float progress = node ? renderer->getDecodeProgress(node) : -1.0f;
+
+        // The evaluation might not have started the decode yet
+        if (node && progress < 0.0f && isEvaluating)
+        {
+            ++it;
+            continue;
+        }
+
+        if (node)
+            node->setDecodeProgress(progress < 1.0f ? progress : -1.0f);
+
+        if (progress >= 0.0f && progress < 1.0f)
+        {
+            ++it;
+            continue;
+        }
+
+        // Decoded, but not rendered yet
+        if (progress >= 1.0f)
+        {
+            hasDecodedImages = true;
+
+            // Large files are streamed while the evaluation renders the node
+            if (isEvaluating)
+            {
+                ++it;
+                continue;
+            }
+        }
+
+        it = decodingNodes.erase(it);
+    }
+
+    if (decodingNodes.isEmpty())
+        decodeTimer.stop();
+
+    // Renders the nodes that were waiting for the files,
+    // a running evaluation might have skipped them already
+    if (hasDecodedImages && lastDisplayRequest)
     {
-        if (renderNodes(node))
-            renderer->displayNode(node);
+        if (isEvaluating)
+            hasUnrenderedDecodes = true;
         else
-            renderer->doClearScreen();
+            handleNodeDisplayRequest(lastDisplayRequest);
     }
-    else
+}
+
+void RenderManager::cancelDecoding(NodeBase* node)
+{
+    // Nothing is decoded before the renderer is set up
+    if (renderer && node->nodeType == NODE_TYPE_READ)
+        renderer->cancelDecoding(node);
+}
+
+void RenderManager::handleRefineTimeout()
+{
+    refineTimer.stop();
+
+    // Try again once the render thread is idle
+    if (isEvaluating)
+    {
+        refineTimer.start();
+        return;
+    }
+
+    if (lastDisplayRequest && renderScale != getDisplayScale())
+    {
+        isRefining = true;
+        processDisplayRequest(lastDisplayRequest);
+        isRefining = false;
+    }
+}
+
+void RenderManager::startEvaluation(NodeBase* node, const DisplayMode mode)
+{
+    if (!node || !node->canBeRendered())
     {
         renderer->doClearScreen();
+        return;
+    }
+
+    updateMemoryBudget();
+
+    evaluatedStates = createRenderStates(node, renderScale, evaluatedAllNodes);
+
+    std::vector<NodeBase*> evaluatedNodes;
+    evaluatedNodes.reserve(evaluatedStates.size());
+    for (const auto& state : evaluatedStates)
+        evaluatedNodes.push_back(state.node);
+    renderer->releaseDecodes(evaluatedNodes);
+    evaluatedNode = node;
+    evaluatedDisplayMode = mode;
+    evaluatedScale = renderScale;
+
+    isEvaluating = true;
+    numEvaluatedNodes = 0;
+    quint64 generation = ++evaluationGeneration;
+
+    // Without a queue of its own the render thread would
+    // race with the viewer, so evaluate right here
+    if (!renderer->canRenderConcurrently())
+    {
+        evaluate(evaluatedStates, renderScale, generation, false);
+        finishEvaluation(true);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(renderThreadMutex);
+        renderThreadBusy = true;
     }
+
+    QMetaObject::invokeMethod(
+                &renderContext,
+                [this, states = evaluatedStates, scale = renderScale, generation]()
+    {
+        evaluate(states, scale, generation, false);
+        {
+            std::lock_guard<std::mutex> lock(renderThreadMutex);
+            renderThreadBusy = false;
+        }
+        renderThreadIdle.notify_all();
+        emit evaluationFinished(generation);
+    },
+    Qt::QueuedConnection);
 }
 
-bool RenderManager::renderNodes(NodeBase *node)
+void RenderManager::handleEvaluationFinished(quint64 generation)
 {
-    bool allNodesRendered = true;
+    // Results of evaluations that were waited for are already handled
+    if (!isEvaluating || generation != evaluationGeneration)
+        return;
+
+    lastEvaluation.restart();
+
+    finishEvaluation(true);
+}
+
+void RenderManager::finishEvaluation(const bool displayResult)
+{
+    isEvaluating = false;
+
+    // Requests that came in while it ran are issued now, also
+    // when the evaluation was waited for instead of finishing
+    if (pendingDisplayRequest)
+        handleNodeDisplayRequest(pendingDisplayRequest);
+    else if (hasUnrenderedDecodes && lastDisplayRequest)
+        handleNodeDisplayRequest(lastDisplayRequest);
+
+    hasUnrenderedDecodes = false;
+
+    // Nodes the evaluation did not get to before it was
+    // cancelled have to be rendered the next time
+    const int numEvaluated = numEvaluatedNodes;
+    for (size_t i = numEvaluated; i < evaluatedStates.size(); ++i)
+    {
+        if (evaluatedStates[i].needsUpdate)
+            evaluatedStates[i].node->needsUpdate = true;
+    }
+
+    bool isComplete = numEvaluated == static_cast<int>(evaluatedStates.size());
+
+    updateInputSizes(numEvaluated);
+    evaluatedStates.clear();
+
+    enforceMemoryBudget();
+
+    if (!displayResult || !isComplete || !evaluatedNode)
+        return;
+
+    renderer->setDisplayMode(evaluatedDisplayMode);
+
+    if (evaluatedAllNodes)
+        renderer->displayNode(evaluatedNode);
+    else
+        renderer->doClearScreen();
+
+    emit renderScaleChanged(evaluatedScale);
+}
+
+void RenderManager::updateInputSizes(const size_t numEvaluated)
+{
+    QHash<NodeBase*, QSize> sizes;
+
+    for (size_t i = 0; i < numEvaluated && i < evaluatedStates.size(); ++i)
+    {
+        const auto& state = evaluatedStates[i];
+        NodeBase* node = state.node;
+
+        // Proxies are derived from the full resolution source
+        if (node->nodeType == NODE_TYPE_READ)
+        {
+            if (auto source = node->getSourceImage())
+                sizes.insert(node, QSize(source->getWidth(), source->getHeight()));
+            continue;
+        }
+
+        if (!state.upstreamBack || !sizes.contains(state.upstreamBack))
+            continue;
+
+        const QSize size = sizes.value(state.upstreamBack);
+        node->setInputSize(size);
+        sizes.insert(node, node->getTargetSize(size, 1));
+    }
+}
+
+void RenderManager::cancelEvaluation()
+{
+    cancelledGeneration = evaluationGeneration;
+
+    // A large file might be streamed to the device right now
+    if (renderer)
+        renderer->cancelStreaming();
+}
+
+void RenderManager::waitForEvaluation()
+{
+    if (!isEvaluating)
+        return;
+
+    cancelEvaluation();
+
+    // The render thread stops at the next node, but the evaluation
+    // might not have started yet, so wait until it has left it
+    {
+        std::unique_lock<std::mutex> lock(renderThreadMutex);
+        renderThreadIdle.wait(lock, [this]() { return !renderThreadBusy; });
+    }
+
+    finishEvaluation(false);
+}
+
+std::vector<NodeRenderState> RenderManager::createRenderStates(
+        NodeBase* node,
+        const int scale,
+        bool& allNodesRenderable)
+{
+    allNodesRenderable = true;
 
     std::vector<NodeBase*> nodes;
     node->getAllUpstreamNodes(nodes);
 
+    std::vector<NodeRenderState> states;
+    // Inputs come first, so their keys are always known
+    QHash<NodeBase*, QByteArray> keys;
+    QHash<NodeBase*, size_t> indices;
+
+    const quint64 stamp = ++useCounter;
+    size_t statesMemoryUsage = 0;
+
     foreach(NodeBase* n, nodes)
     {
-        if (n->canBeRendered())
-            renderNode(n);
+        if (!n->canBeRendered())
+        {
+            allNodesRenderable = false;
+            continue;
+        }
+
+        n->takeParameterSnapshot();
+
+        NodeRenderState state;
+        state.node = n;
+        state.upstreamBack = n->getUpstreamNodeBack();
+        state.upstreamFront = n->getUpstreamNodeFront();
+        state.needsUpdate = n->needsUpdate;
+        state.cacheKey = createCacheKey(
+                    n,
+                    keys.value(state.upstreamBack),
+                    keys.value(state.upstreamFront),
+                    scale);
+        keys.insert(n, state.cacheKey);
+
+        state.lastUse = states.size();
+        state.isPinned = isPinned(n, node);
+        state.isFused = false;
+        for (auto input : { state.upstreamBack, state.upstreamFront })
+        {
+            if (indices.contains(input))
+                states[indices.value(input)].lastUse = states.size();
+        }
+        indices.insert(n, states.size());
+
+        n->lastUsed = stamp;
+        statesMemoryUsage += n->getCachedMemorySize();
+
+        if (n->nodeType == NODE_TYPE_READ)
+        {
+            // A node cached at a different resolution has to be rendered again
+            state.isOutdated = n->needsUpdate ||
+                    n->cachedImageScale != scale ||
+                    n->cachedImageKey != state.cacheKey ||
+                    !n->getSourceImage();
+
+            if ((n->needsUpdate || !n->getSourceImage()) && !decodingNodes.contains(n))
+            {
+                decodingNodes.append(n);
+                decodeTimer.start();
+            }
+        }
         else
-            allNodesRendered = false;
+        {
+            // Nodes whose parameters and inputs ended up where
+            // they were at the last render keep their image
+            state.isOutdated = n->cachedImageKey != state.cacheKey ||
+                    !n->getCachedImage();
+        }
+
+        n->needsUpdate = false;
+
+        states.push_back(state);
     }
 
-    return allNodesRendered;
+    // Nodes that were fused into their reader, or lost their image to the
+    // memory budget, only render again if a reader or the viewer needs them.
+    // Readers come later, so going backwards they are decided first.
+    QSet<NodeBase*> neededInputs;
+    for (auto it = states.rbegin(); it != states.rend(); ++it)
+    {
+        NodeBase* n = it->node;
+        if (it->isOutdated && !it->isPinned && n->nodeType != NODE_TYPE_READ &&
+            n->cachedImageKey == it->cacheKey && !n->getCachedImage())
+        {
+            it->isOutdated = neededInputs.contains(n);
+        }
+
+        if (it->isOutdated)
+        {
+            neededInputs.insert(it->upstreamBack);
+            neededInputs.insert(it->upstreamFront);
+        }
+    }
+
+    baseMemoryUsage = getNodesMemoryUsage() - statesMemoryUsage;
+
+    fuseRenderStates(states);
+
+    return states;
 }
 
-void RenderManager::renderNode(NodeBase *node)
+void RenderManager::fuseRenderStates(std::vector<NodeRenderState>& states) const
 {
-    // Read node
-    if (node->nodeType == NODE_TYPE_READ && node->needsUpdate)
+    QHash<NodeBase*, size_t> indices;
+    QHash<NodeBase*, int> numReaders;
+
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        indices.insert(states[i].node, i);
+        for (auto input : { states[i].upstreamBack, states[i].upstreamFront })
+        {
+            if (input)
+                numReaders[input]++;
+        }
+    }
+
+    for (size_t i = 0; i < states.size(); ++i)
+    {
+        auto& state = states[i];
+
+        if (!state.isOutdated || state.upstreamFront || !indices.contains(state.upstreamBack))
+            continue;
+
+        auto& input = states[indices.value(state.upstreamBack)];
+
+        // Only inputs nothing else reads and nobody looks at
+        // can be left without an image
+        if (!input.isOutdated || input.isPinned || input.upstreamFront ||
+            numReaders.value(input.node) != 1 || !indices.contains(input.upstreamBack))
+        {
+            continue;
+        }
+
+        auto chain = input.fusedNodes;
+        chain.push_back(input.node);
+
+        std::vector<NodeType> types;
+        for (auto n : chain)
+            types.push_back(n->nodeType);
+        types.push_back(state.node->nodeType);
+
+        if (!renderer->canFuseNodes(types))
+            continue;
+
+        input.isFused = true;
+        input.fusedNodes.clear();
+
+        // This node reads the input of the whole chain now
+        state.fusedNodes = chain;
+        state.upstreamBack = input.upstreamBack;
+
+        auto& chainInput = states[indices.value(state.upstreamBack)];
+        chainInput.lastUse = std::max(chainInput.lastUse, i);
+    }
+}
+
+void RenderManager::evaluate(
+        const std::vector<NodeRenderState>& states,
+        const int scale,
+        const quint64 generation,
+        const bool waitForDecodes)
+{
+    size_t statesMemoryUsage = 0;
+    std::vector<NodeBase*> decodedNodes;
+
+    {
+        std::lock_guard<std::mutex> lock(evaluationMutex);
+
+        // Nodes of a cancelled evaluation might be gone already
+        if (generation <= cancelledGeneration)
+            return;
+
+        for (const auto& state : states)
+        {
+            statesMemoryUsage += state.node->getCachedMemorySize();
+
+            // Spilled images on disk are read while earlier nodes render,
+            // unless restoreSpilledImage would render them anyway
+            const size_t spilledBytes = state.isOutdated ? spillCache.getBytes(state.cacheKey) : 0;
+            if (spilledBytes > 0 && state.node->renderCost >= getTransferCost(spilledBytes))
+                spillCache.prefetch(state.cacheKey);
+
+            // Same for the files of all branches of the graph
+            if (state.isOutdated && state.node->nodeType == NODE_TYPE_READ &&
+                (state.needsUpdate || !state.node->getSourceImage()))
+            {
+                decodedNodes.push_back(state.node);
+            }
+        }
+        renderer->startDecoding(decodedNodes);
+    }
+
+    // Nodes that are waiting for a file and the nodes reading them
+    std::unordered_set<NodeBase*> waitingNodes;
+
+    for (size_t i = 0; i < states.size(); ++i)
     {
-        if (node->canBeRendered())
+        std::lock_guard<std::mutex> lock(evaluationMutex);
+
+        // Cancellation only happens between nodes
+        if (generation <= cancelledGeneration)
+            break;
+
+        NodeBase* node = states[i].node;
+
+        bool isWaiting = waitingNodes.count(states[i].upstreamBack) ||
+                waitingNodes.count(states[i].upstreamFront);
+        if (!waitForDecodes && states[i].isOutdated && node->nodeType == NODE_TYPE_READ)
+            isWaiting = renderer->isDecoding(node);
+
+        // Their images stay as they are until the decode is done
+        if (isWaiting)
         {
-            renderer->processReadNode(node);
+            waitingNodes.insert(node);
+            numEvaluatedNodes++;
+            continue;
         }
+        statesMemoryUsage -= node->getCachedMemorySize();
+
+        renderNode(states[i], scale);
+
+        statesMemoryUsage += node->getCachedMemorySize();
+
+        if (baseMemoryUsage + statesMemoryUsage + resultCache.getUsedBytes() > memoryBudget)
+            releaseConsumedImages(states, i, statesMemoryUsage);
+
+        numEvaluatedNodes++;
+    }
+
+    // Copies read ahead for nodes that were not rendered from them
+    spillCache.releasePrefetched();
+}
+
+bool RenderManager::renderNodes(NodeBase *node, const int scale)
+{
+    bool allNodesRendered = true;
+
+    updateMemoryBudget();
+
+    auto states = createRenderStates(node, scale, allNodesRendered);
+
+    // Files are saved with everything in them
+    evaluate(states, scale, ++evaluationGeneration, true);
+
+    enforceMemoryBudget();
+
+    return allNodesRendered;
+}
+
+void RenderManager::updateMemoryBudget()
+{
+    int budget = PreferencesManager::getInstance().getGpuMemoryBudget();
+    if (budget > 0)
+        memoryBudget = size_t(budget) * 1024 * 1024;
+    else
+        memoryBudget = renderer->getDeviceMemoryBudget();
+
+    for (auto& i : resultCache.setBudget(memoryBudget))
+    {
+        renderer->retireImage(std::move(i));
+    }
+}
+
+size_t RenderManager::getNodesMemoryUsage() const
+{
+    size_t usage = 0;
+    for (auto& n : nodeGraph->getNodes())
+        usage += n->getCachedMemorySize();
+
+    return usage;
+}
+
+bool RenderManager::isPinned(NodeBase* node, NodeBase* root) const
+{
+    return root && (node == root ||
+                    node == root->getUpstreamNodeBack() ||
+                    node == root->getUpstreamNodeFront());
+}
+
+void RenderManager::releaseNodeImages(NodeBase* node)
+{
+    spillNodeImage(node);
+
+    // The node renders again the next time it is needed
+    renderer->retireImage(node->setCachedImage(nullptr));
+    renderer->retireImage(node->setSourceImage(nullptr));
+}
+
+double RenderManager::getTransferCost(const size_t bytes) const
+{
+    return transferMsPerMB * bytes / (1024.0 * 1024.0);
+}
+
+void RenderManager::spillNodeImage(NodeBase* node)
+{
+    CsImage* image = node->getCachedImage();
+
+    if (!image || node->nodeType == NODE_TYPE_READ || node->cachedImageKey.isEmpty())
+        return;
+
+    if (!spillCache.isEnabled() || spillCache.contains(node->cachedImageKey))
+        return;
+
+    // Reading back and uploading again has to beat rendering again
+    if (node->renderCost < getTransferCost(image->getMemorySize()))
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto spilled = std::make_shared<Renderer::SpilledImage>();
+    spilled->width = image->getWidth();
+    spilled->height = image->getHeight();
+    spilled->pixels = renderer->downloadImage(image);
+
+    if (spilled->pixels.empty())
+        return;
+
+    spillCache.store(node->cachedImageKey, spilled);
+
+    // Download and upload take about the same time
+    double ms = 2.0 * timer.nsecsElapsed() / 1.0e6;
+    transferMsPerMB = 0.8 * transferMsPerMB + 0.2 * ms / (image->getMemorySize() / (1024.0 * 1024.0));
+}
+
+std::unique_ptr<CsImage> RenderManager::restoreSpilledImage(
+        NodeBase* node,
+        const QByteArray& key)
+{
+    // Checked before anything is read from disk
+    const size_t bytes = spillCache.getBytes(key);
+    if (bytes == 0 || node->renderCost < getTransferCost(bytes))
+        return nullptr;
+
+    auto spilled = spillCache.load(key);
+    if (!spilled)
+        return nullptr;
+
+    return renderer->uploadImage(spilled->pixels.data(), spilled->width, spilled->height);
+}
+
+void RenderManager::enforceMemoryBudget()
+{
+    size_t usage = getNodesMemoryUsage() + resultCache.getUsedBytes();
+    if (usage <= memoryBudget)
+        return;
+
+    // Results no node shows right now go first
+    for (auto& i : resultCache.evictBytes(usage - memoryBudget))
+    {
+        renderer->retireImage(std::move(i));
+    }
+    usage = getNodesMemoryUsage() + resultCache.getUsedBytes();
+
+    auto nodes = nodeGraph->getNodes();
+    std::sort(nodes.begin(), nodes.end(), [](NodeBase* a, NodeBase* b)
+    {
+        return a->lastUsed < b->lastUsed;
+    });
+
+    for (auto& n : nodes)
+    {
+        if (usage <= memoryBudget)
+            break;
+
+        if (isPinned(n, nodeGraph->getViewedNode()) || isPinned(n, evaluatedNode))
+            continue;
+
+        usage -= n->getCachedMemorySize();
+        releaseNodeImages(n);
+    }
+    renderer->releaseRetiredImages();
+}
+
+void RenderManager::releaseConsumedImages(
+        const std::vector<NodeRenderState>& states,
+        const size_t index,
+        size_t& statesMemoryUsage)
+{
+    size_t usage = baseMemoryUsage + statesMemoryUsage + resultCache.getUsedBytes();
+
+    for (auto& i : resultCache.evictBytes(usage - memoryBudget))
+    {
+        renderer->retireImage(std::move(i));
+    }
+    usage = baseMemoryUsage + statesMemoryUsage + resultCache.getUsedBytes();
+
+    // Nodes every reader of has already been rendered
+    for (size_t i = 0; i < index && usage > memoryBudget; ++i)
+    {
+        if (states[i].isPinned || states[i].lastUse > index)
+            continue;
+
+        size_t size = states[i].node->getCachedMemorySize();
+        usage -= size;
+        statesMemoryUsage -= size;
+        releaseNodeImages(states[i].node);
+    }
+
+    // Images can only be destroyed on the GUI thread, and not while a
+    // node is rendered. If one is, finishEvaluation releases them.
+    QMetaObject::invokeMethod(this, [this]()
+    {
+        std::unique_lock<std::mutex> lock(evaluationMutex, std::try_to_lock);
+        if (lock.owns_lock())
+            renderer->releaseRetiredImages();
+    },
+    Qt::QueuedConnection);
+}
+
+bool RenderManager::hasPendingUpdates(NodeBase *node)
+{
+    std::vector<NodeBase*> nodes;
+    node->getAllUpstreamNodes(nodes);
+
+    foreach(NodeBase* n, nodes)
+    {
+        if (n->needsUpdate)
+            return true;
+    }
+    return false;
+}
+
+void RenderManager::renderNode(const NodeRenderState& state, const int scale)
+{
+    NodeBase* node = state.node;
+
+    if (!state.isOutdated)
+        return;
+
+    // Rendered together with the node reading it. The key stays, so
+    // the node is not outdated as long as its reader keeps its image.
+    if (state.isFused)
+    {
+        storeResult(node->cachedImageKey, node->setCachedImage(nullptr));
+        node->cachedImageScale = scale;
+        node->cachedImageKey = state.cacheKey;
+        return;
+    }
+
+    // Read node
+    if (node->nodeType == NODE_TYPE_READ)
+    {
+        // Keeps the old key, so the file is read again next time
+        if (!renderer->processReadNode(node, state.needsUpdate, scale))
+            return;
+    }
+    // The same result was computed before
+    else if (auto image = resultCache.take(state.cacheKey))
+    {
+        storeResult(node->cachedImageKey, node->setCachedImage(std::move(image)));
+    }
+    // Evicted earlier, but copying it back is cheaper than rendering it
+    else if (auto image = restoreSpilledImage(node, state.cacheKey))
+    {
+        storeResult(node->cachedImageKey, node->setCachedImage(std::move(image)));
     }
     // All other nodes
-    else if (node->getUpstreamNodeBack() && node->needsUpdate)
+    else if (state.upstreamBack)
     {
-        CsImage* inputImageBack = nullptr;
+        storeResult(node->cachedImageKey, node->setCachedImage(nullptr));
+
+        QElapsedTimer timer;
+        timer.start();
+
+        CsImage* inputImageBack = state.upstreamBack->getCachedImage();
         CsImage* inputImageFront = nullptr;
 
-        inputImageBack = node->getUpstreamNodeBack()->getCachedImage();
+        if (state.upstreamFront)
+            inputImageFront = state.upstreamFront->getCachedImage();
+
+        // Sizes follow from the images this evaluation rendered, not from the graph
+        auto sizeOf = [](const CsImage* image)
+        {
+            return image ? QSize(image->getWidth(), image->getHeight()) : QSize(0, 0);
+        };
+
+        // The last node of a chain of per-pixel nodes
+        if (!state.fusedNodes.empty() && inputImageBack)
+        {
+            auto nodes = state.fusedNodes;
+            nodes.push_back(node);
 
+            if (!renderer->processFusedNodes(
+                        nodes,
+                        inputImageBack,
+                        node->getTargetSize(sizeOf(inputImageBack), scale),
+                        scale))
+            {
+                // Render them one by one if the chain did not compile,
+                // the keys of the fused nodes were set when they were skipped
+                foreach (NodeBase* n, nodes)
+                {
+                    renderer->processNode(
+                                n,
+                                inputImageBack,
+                                nullptr,
+                                n->getTargetSize(sizeOf(inputImageBack), scale),
+                                scale);
+                    inputImageBack = n->getCachedImage();
+                    n->cachedImageScale = scale;
+                }
+            }
+        }
         // A node that has a front and back image
-        if(node->getUpstreamNodeFront() && node->getUpstreamNodeFront()->getCachedImage())
+        else if (inputImageFront)
         {
-            inputImageFront = node->getUpstreamNodeFront()->getCachedImage();
-            renderer->processNode(node, inputImageBack, inputImageFront, node->getTargetSize());
+            renderer->processNode(
+                        node,
+                        inputImageBack,
+                        inputImageFront,
+                        node->getTargetSize(sizeOf(inputImageBack), scale),
+                        scale);
         }
         // A node without a front image
         else if (inputImageBack)
         {
-            renderer->processNode(node, inputImageBack, nullptr, node->getTargetSize());
+            renderer->processNode(
+                        node,
+                        inputImageBack,
+                        nullptr,
+                        node->getTargetSize(sizeOf(inputImageBack), scale),
+                        scale);
         }
+
+        node->renderCost = timer.nsecsElapsed() / 1.0e6 + state.upstreamBack->renderCost;
+        if (state.upstreamFront)
+            node->renderCost += state.upstreamFront->renderCost;
+    }
+    node->cachedImageScale = scale;
+    node->cachedImageKey = state.cacheKey;
+}
+
+QByteArray RenderManager::createCacheKey(
+        NodeBase* node,
+        const QByteArray& keyBack,
+        const QByteArray& keyFront,
+        const int scale) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    const auto& params = node->getParameterSnapshot();
+
+    hash.addData(QByteArray::number(node->nodeType) + "|");
+    hash.addData(QByteArrayView(
+                     reinterpret_cast<const char*>(params.values.data()),
+                     params.values.size() * sizeof(float)));
+    for (int i = 0; i < static_cast<int>(params.values.size()); ++i)
+    {
+        if (params.text.contains(i))
+            hash.addData("|" + params.text.value(i).toUtf8());
+    }
+    hash.addData("|");
+
+    const auto& code = node->getShaderCodeSnapshot();
+    hash.addData(QByteArrayView(
+                     reinterpret_cast<const char*>(code.data()),
+                     code.size() * sizeof(unsigned int)));
+
+    // The sizes of the inputs follow from their keys
+    hash.addData("|" + keyBack + "|" + keyFront + "|");
+    hash.addData(QByteArray::number(scale));
+
+    if (node->nodeType == NODE_TYPE_READ)
+    {
+        // Same layout as in VulkanRenderer::processReadNode
+        const auto& values = params.values;
+        if (values.size() > 1)
+        {
+            int index = std::max(static_cast<int>(values[values.size() - 2]), 0);
+            QFileInfo file(params.text.value(index));
+            hash.addData("|" + QByteArray::number(file.lastModified().toMSecsSinceEpoch()));
+            hash.addData("|" + QByteArray::number(file.size()));
+        }
+    }
+    return hash.result();
+}
+
+void RenderManager::storeResult(
+        const QByteArray& key,
+        std::unique_ptr<CsImage> image)
+{
+    if (!image)
+        return;
+
+    if (key.isEmpty())
+    {
+        renderer->retireImage(std::move(image));
+        return;
+    }
+
+    auto evicted = resultCache.insert(key, std::move(image));
+    for (auto& i : evicted)
+    {
+        renderer->retireImage(std::move(i));
     }
-    node->needsUpdate = false;
 }
 
 } // namespace Cascade
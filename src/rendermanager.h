@@ -20,10 +20,20 @@
 #ifndef RENDERMANAGER_H
 #define RENDERMANAGER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
 #include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
 
 #include "nodebase.h"
 #include "nodedefinitions.h"
+#include "renderer/resultcache.h"
+#include "renderer/spillcache.h"
 
 namespace Cascade::Renderer
 {
@@ -34,6 +44,26 @@ namespace Cascade {
 
 class NodeGraph;
 
+// Everything the render thread needs to know about a node,
+// captured on the GUI thread when an evaluation is started
+struct NodeRenderState
+{
+    NodeBase* node;
+    NodeBase* upstreamBack;
+    NodeBase* upstreamFront;
+    bool needsUpdate;
+    bool isOutdated;
+    QByteArray cacheKey;
+    // Index of the last node in the evaluation that reads this one
+    size_t lastUse;
+    // The displayed node and its inputs are never evicted
+    bool isPinned;
+    // Rendered by the shader of the node reading it, gets no image
+    bool isFused;
+    // Nodes this one runs in its own shader first, in order
+    std::vector<NodeBase*> fusedNodes;
+};
+
 class RenderManager : public QObject
 {
     Q_OBJECT
@@ -47,17 +77,133 @@ public:
 
     void updateViewerPushConstants(const QString& s);
 
+    void setProxyScale(const int s);
+    void setViewerZoom(const float z);
+
+    // Has to be called before nodes or their caches are destroyed
+    void waitForEvaluation();
+    void cancelDecoding(NodeBase* node);
+    void shutdown();
+
+    const Renderer::ResultCache& getResultCache() const;
+
 private:
     RenderManager() {}
-    void displayNode(NodeBase* node);
-    bool renderNodes(NodeBase* node);
-    void renderNode(NodeBase* node);
+    void processDisplayRequest(NodeBase* node);
+    void startEvaluation(NodeBase* node, const DisplayMode mode);
+    void finishEvaluation(const bool displayResult);
+    // From the evaluated states at full resolution, for the
+    // properties that show pixel sizes
+    void updateInputSizes(const size_t numEvaluated);
+    // The render thread stops at the next node or band
+    void cancelEvaluation();
+    std::vector<NodeRenderState> createRenderStates(
+            NodeBase* node,
+            const int scale,
+            bool& allNodesRenderable);
+    void fuseRenderStates(std::vector<NodeRenderState>& states) const;
+    // Without waiting, nodes whose files are still being
+    // decoded keep their images and render once they arrived
+    void evaluate(
+            const std::vector<NodeRenderState>& states,
+            const int scale,
+            const quint64 generation,
+            const bool waitForDecodes);
+    bool renderNodes(NodeBase* node, const int scale);
+    void prefetchBatchImages(NodeBase* node);
+    void renderNode(const NodeRenderState& state, const int scale);
+    QByteArray createCacheKey(
+            NodeBase* node,
+            const QByteArray& keyBack,
+            const QByteArray& keyFront,
+            const int scale) const;
+    void storeResult(
+            const QByteArray& key,
+            std::unique_ptr<CsImage> image);
+
+    void updateMemoryBudget();
+    size_t getNodesMemoryUsage() const;
+    void enforceMemoryBudget();
+    void releaseConsumedImages(
+            const std::vector<NodeRenderState>& states,
+            const size_t index,
+            size_t& statesMemoryUsage);
+    void releaseNodeImages(NodeBase* node);
+    void spillNodeImage(NodeBase* node);
+    std::unique_ptr<CsImage> restoreSpilledImage(
+            NodeBase* node,
+            const QByteArray& key);
+    double getTransferCost(const size_t bytes) const;
+    bool isPinned(NodeBase* node, NodeBase* root) const;
+    bool hasPendingUpdates(NodeBase* node);
+    int getDisplayScale() const;
 
     VulkanRenderer* renderer;
     NodeGraph* nodeGraph;
 
     WindowManager* wManager;
 
+    // Divisor of the resolution used while parameters are changing, 1 is off
+    int proxyScale = 1;
+    // Divisor of the resolution of the current evaluation
+    int renderScale = 1;
+    float viewerZoom = 1.0f;
+    bool isRefining = false;
+
+    QTimer refineTimer;
+    QPointer<NodeBase> lastDisplayRequest;
+
+    // Display requests are coalesced to one evaluation per display refresh
+    QTimer displayTimer;
+    QElapsedTimer lastEvaluation;
+    QPointer<NodeBase> pendingDisplayRequest;
+
+    // Read nodes with a decode running, polled for their progress
+    QTimer decodeTimer;
+    QList<QPointer<NodeBase>> decodingNodes;
+    // A decode finished while an evaluation was running
+    bool hasUnrenderedDecodes = false;
+
+    // Graph evaluation runs on the render thread, it only reads
+    // node connections and parameters captured in NodeRenderState
+    QThread renderThread;
+    QObject renderContext;
+    // Held by the render thread while a node is rendered
+    std::mutex evaluationMutex;
+    // Set from queueing an evaluation until the render thread
+    // has left it, waitForEvaluation blocks until it is cleared
+    bool renderThreadBusy = false;
+    std::mutex renderThreadMutex;
+    std::condition_variable renderThreadIdle;
+    std::atomic<quint64> cancelledGeneration = 0;
+    std::atomic<int> numEvaluatedNodes = 0;
+    quint64 evaluationGeneration = 0;
+    bool isEvaluating = false;
+
+    std::vector<NodeRenderState> evaluatedStates;
+    QPointer<NodeBase> evaluatedNode;
+    DisplayMode evaluatedDisplayMode = DISPLAY_MODE_RGB;
+    bool evaluatedAllNodes = true;
+    int evaluatedScale = 1;
+
+    // Only accessed by whichever thread is evaluating
+    Renderer::ResultCache resultCache;
+
+    // Device memory all node images and the result cache may use
+    size_t memoryBudget = Renderer::defaultResultCacheBudget;
+    // Memory used by nodes outside of the running evaluation
+    size_t baseMemoryUsage = 0;
+    quint64 useCounter = 0;
+
+    // Evicted images that are cheaper to copy back than to render again
+    Renderer::SpillCache spillCache;
+    // Measured time a round trip to the host takes
+    double transferMsPerMB = 0.5;
+
+signals:
+    void renderScaleChanged(int scale);
+    void evaluationFinished(quint64 generation);
+
 public slots:
     void handleNodeDisplayRequest(NodeBase* node);
     void handleNodeFileSaveRequest(
@@ -67,6 +213,10 @@ public slots:
             const bool isBatch,
             const bool isLast);
     void handleClearScreenRequest();
+    void handleRefineTimeout();
+    void handleDisplayTimeout();
+    void handleDecodeTimeout();
+    void handleEvaluationFinished(quint64 generation);
 };
 
 } // namespace Cascade
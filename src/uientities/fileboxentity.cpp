@@ -128,8 +128,14 @@ QString FileBoxEntity::getValuesAsString()
 void FileBoxEntity::loadPropertyValues(const QString &values)
 {
     auto split = values.split(",");
+    bool isNumber = false;
+    const int current = split.last().toInt(&isNumber);
     split.removeLast();
     addEntries(split);
+
+    // Same file as saved, so the values read back as they were loaded
+    if (isNumber && current >= 0 && current < ui->fileListWidget->count())
+        ui->fileListWidget->setCurrentRow(current);
 }
 
 bool FileBoxEntity::fileExists(const QString& path)
@@ -68,7 +68,11 @@ void ResizePropertiesEntity::loadPropertyValues(const QString &values)
 
 void ResizePropertiesEntity::handleNodeRequestUpdate()
 {
-    setInputSize(parentNode->getInputSize());
+    // Unknown until the input was rendered once,
+    // the pixel sizes would end up as zero otherwise
+    const QSize size = parentNode->getInputSize();
+    if (!size.isEmpty())
+        setInputSize(size);
 }
 
 void ResizePropertiesEntity::setParentNode(NodeBase* node)
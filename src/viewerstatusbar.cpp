@@ -63,6 +63,21 @@ ViewerStatusBar::ViewerStatusBar(QWidget *parent) :
     gainSlider->setMinMaxStepValue(0.0, 5.0, 0.01, 1.0);
     ui->horizontalLayout->insertWidget(16, gainSlider);
 
+    // Resolution of the displayed image and the proxy used while editing
+    renderScaleLabel = new QLabel(this);
+    renderScaleLabel->setMinimumWidth(40);
+    ui->horizontalLayout->insertWidget(7, renderScaleLabel);
+
+    auto proxyLabel = new QLabel("Proxy", this);
+    ui->horizontalLayout->insertWidget(8, proxyLabel);
+
+    proxyBox = new QComboBox(this);
+    proxyBox->addItem("Off", 1);
+    proxyBox->addItem("1/2", 2);
+    proxyBox->addItem("1/4", 4);
+    proxyBox->addItem("1/8", 8);
+    ui->horizontalLayout->insertWidget(9, proxyBox);
+
     connect(ui->zoomResetButton, &QPushButton::clicked,
             this, &ViewerStatusBar::requestZoomReset);
     connect(ui->splitCheckBox, &QCheckBox::toggled,
@@ -77,6 +92,8 @@ ViewerStatusBar::ViewerStatusBar(QWidget *parent) :
             this, &ViewerStatusBar::handleSplitSliderChanged);
     connect(ui->viewerModeBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &ViewerStatusBar::handleViewerModeCheckBoxChanged);
+    connect(proxyBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &ViewerStatusBar::handleProxyBoxChanged);
 }
 
 void ViewerStatusBar::setZoomText(const QString &s)
@@ -94,6 +111,11 @@ void ViewerStatusBar::setHeightText(const QString &s)
     ui->heightLabel->setText(s);
 }
 
+void ViewerStatusBar::setRenderScaleText(const QString &s)
+{
+    renderScaleLabel->setText(s);
+}
+
 void ViewerStatusBar::setViewerMode(const ViewerMode m)
 {
     ui->viewerModeBox->setCurrentIndex(m);
@@ -139,6 +161,12 @@ void ViewerStatusBar::handleViewerModeCheckBoxChanged()
     emit valueChanged();
 }
 
+void ViewerStatusBar::handleProxyBoxChanged()
+{
+    emit proxyScaleChanged(proxyBox->currentData().toInt());
+    proxyBox->clearFocus();
+}
+
 QString ViewerStatusBar::getViewerSettings()
 {
     // Only use set split viewer on RGB Out or Alpha Out view
@@ -21,6 +21,8 @@
 #define VIEWERSTATUSBAR_H
 
 #include <QWidget>
+#include <QLabel>
+#include <QComboBox>
 
 #include "uientities/cssliderboxentity.h"
 #include "global.h"
@@ -41,6 +43,7 @@ public:
     void setZoomText(const QString& s);
     void setWidthText(const QString& s);
     void setHeightText(const QString& s);
+    void setRenderScaleText(const QString& s);
     void setViewerMode(const ViewerMode m);
 
     QString getViewerSettings();
@@ -58,10 +61,14 @@ private:
     CsSliderBoxEntity* gammaSlider;
     CsSliderBoxEntity* gainSlider;
 
+    QLabel* renderScaleLabel;
+    QComboBox* proxyBox;
+
 signals:
     void requestZoomReset();
     void valueChanged();
     void viewerModeChanged(const Cascade::ViewerMode mode);
+    void proxyScaleChanged(const int scale);
 
 public slots:
     void handleSplitToggled();
@@ -69,6 +76,7 @@ public slots:
     void handleBwToggled();
     void handleValueChanged();
     void handleViewerModeCheckBoxChanged();
+    void handleProxyBoxChanged();
 };
 
 } // namespace Cascade
@@ -22,6 +22,8 @@
 #include <QMouseEvent>
 #include <QLabel>
 
+#include <algorithm>
+
 #include "renderer/vulkanrenderer.h"
 #include "log.h"
 
@@ -67,6 +69,49 @@ QVulkanWindowRenderer *VulkanWindow::createRenderer()
         emit noGPUFound();
     }
 
+    // Unsupported extensions are filtered out by Qt
+    this->setDeviceExtensions(Renderer::deviceExtensions);
+
+    // Graph evaluation runs on its own thread, give it a compute queue
+    // of its own so it never submits to the queue the viewer uses
+    this->setQueueCreateInfoModifier(
+                [](const VkQueueFamilyProperties* properties,
+                   uint32_t count,
+                   QList<VkDeviceQueueCreateInfo>& infos)
+    {
+        static const float priorities[] = { 1.0f, 1.0f };
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!(properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT))
+                continue;
+
+            const uint32_t queueCount = properties[i].queueCount > 1 ? 2 : 1;
+
+            bool found = false;
+            for (auto& info : infos)
+            {
+                if (info.queueFamilyIndex == i)
+                {
+                    info.queueCount = std::max(info.queueCount, queueCount);
+                    info.pQueuePriorities = priorities;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                VkDeviceQueueCreateInfo info = {};
+                info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+                info.queueFamilyIndex = i;
+                info.queueCount = queueCount;
+                info.pQueuePriorities = priorities;
+                infos.append(info);
+            }
+            // Same family as picked in CsCommandBuffer
+            break;
+        }
+    });
+
     renderer = new VulkanRenderer(this);
 
     return renderer;
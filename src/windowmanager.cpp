@@ -64,12 +64,17 @@ void WindowManager::setUp(
             this, &WindowManager::handleViewerStatusBarValueChanged);
     connect(viewerStatusBar, &ViewerStatusBar::viewerModeChanged,
             this, &WindowManager::handleViewerModeChanged);
+    connect(viewerStatusBar, &ViewerStatusBar::proxyScaleChanged,
+            this, &WindowManager::handleProxyScaleChanged);
 
     // Outgoing
     connect(this, &WindowManager::deleteKeyPressed,
             nodeGraph, &NodeGraph::handleDeleteKeyPressed);
 
     rManager = &RenderManager::getInstance();
+
+    connect(rManager, &RenderManager::renderScaleChanged,
+            this, &WindowManager::handleRenderScaleChanged);
 }
 
 ViewerMode WindowManager::getViewerMode()
@@ -149,6 +154,8 @@ void WindowManager::handleNodeDoubleClicked(NodeBase* node)
 void WindowManager::handleZoomTextUpdateRequest(float f)
 {
     viewerStatusBar->setZoomText(QString::number(static_cast<int>(f * 100)));
+
+    rManager->setViewerZoom(f);
 }
 
 void WindowManager::handleRenderTargetCreated(int w, int h)
@@ -157,6 +164,19 @@ void WindowManager::handleRenderTargetCreated(int w, int h)
     viewerStatusBar->setHeightText(QString::number(h));
 }
 
+void WindowManager::handleRenderScaleChanged(int scale)
+{
+    if (scale == 1)
+        viewerStatusBar->setRenderScaleText("Full");
+    else
+        viewerStatusBar->setRenderScaleText("1/" + QString::number(scale));
+}
+
+void WindowManager::handleProxyScaleChanged(const int scale)
+{
+    rManager->setProxyScale(scale);
+}
+
 void WindowManager::handleViewerModeChanged(const Cascade::ViewerMode mode)
 {
     setViewerMode(mode);
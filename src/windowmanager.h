@@ -72,6 +72,8 @@ public slots:
     void handleNodeDoubleClicked(Cascade::NodeBase* node);
     void handleZoomTextUpdateRequest(float f);
     void handleRenderTargetCreated(int w, int h);
+    void handleRenderScaleChanged(int scale);
+    void handleProxyScaleChanged(const int scale);
     void handleViewerStatusBarValueChanged();
     void handleClearPropertiesRequest();
     void handleViewerModeChanged(const Cascade::ViewerMode mode);
@@ -23,6 +23,7 @@ DEFINES += "VERSION_MAJOR=$$VERSION_MAJOR"\
 HEADERS += \
         tst_cssliderboxtests.h \
         tst_nodebasetests.h \
+        tst_nodegraphtests.h \
         ../../src/benchmark.h \
         ../../src/colorbutton.h \
         ../../src/connection.h \
@@ -1,6 +1,7 @@
 #include "tst_nodebasetests.h"
 #include "tst_cssliderboxtests.h"
 #include "tst_resizepropertiesentitytests.h"
+#include "tst_nodegraphtests.h"
 
 #include <QApplication>
 
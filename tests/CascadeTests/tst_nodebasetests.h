@@ -1,6 +1,8 @@
 #ifndef TST_NODEBASETESTS_H
 #define TST_NODEBASETESTS_H
 
+#include <chrono>
+
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -110,6 +112,102 @@ TEST_F(NodeBaseTest, getAllUpstreamNodes_CorrectOrderOfNodes)
     EXPECT_EQ(nodes[5]->getID(), writeNode->getID());
 }
 
+TEST_F(NodeBaseTest, getAllUpstreamNodes_SharedNodeOnlyOnce)
+{
+    // Read1 feeds the new Merge directly and through Color
+    auto merge = new NodeBase(NODE_TYPE_MERGE, nodeGraph);
+
+    auto c = nodeGraph->createOpenConnection(colorNode->getRgbaOut());
+    connections.push_back(c);
+    nodeGraph->establishConnection(merge->getRgbaBackIn());
+
+    c = nodeGraph->createOpenConnection(readNode1->getRgbaOut());
+    connections.push_back(c);
+    nodeGraph->establishConnection(merge->getRgbaFrontIn());
+
+    std::vector<NodeBase*> nodes;
+    merge->getAllUpstreamNodes(nodes);
+
+    EXPECT_EQ(nodes.size(), 3);
+    EXPECT_EQ(nodes[0]->getID(), readNode1->getID());
+    EXPECT_EQ(nodes[1]->getID(), colorNode->getID());
+    EXPECT_EQ(nodes[2]->getID(), merge->getID());
+
+    delete merge;
+}
+
+TEST_F(NodeBaseTest, getAllUpstreamNodes_DiamondLatticeIsLinear)
+{
+    /*
+     * 30 stacked diamonds, every level doubles the
+     * number of paths from the Read node to the top
+     *
+     *          - | Color | -
+     *         /             \
+     * | Node | -- | Color | -- | Merge | --- ...
+    */
+
+    const int numLevels = 30;
+
+    std::vector<NodeBase*> latticeNodes;
+    NodeBase* top = readNode1;
+
+    auto connectNodes = [this](NodeBase* src, NodeInput* dst)
+    {
+        connections.push_back(nodeGraph->createOpenConnection(src->getRgbaOut()));
+        nodeGraph->establishConnection(dst);
+    };
+
+    for (int i = 0; i < numLevels; ++i)
+    {
+        auto left = new NodeBase(NODE_TYPE_COLOR, nodeGraph);
+        auto right = new NodeBase(NODE_TYPE_COLOR, nodeGraph);
+        auto merge = new NodeBase(NODE_TYPE_MERGE, nodeGraph);
+
+        connectNodes(top, left->getRgbaBackIn());
+        connectNodes(top, right->getRgbaBackIn());
+        connectNodes(left, merge->getRgbaBackIn());
+        connectNodes(right, merge->getRgbaFrontIn());
+
+        latticeNodes.insert(latticeNodes.end(), { left, right, merge });
+        top = merge;
+    }
+
+    std::vector<NodeBase*> nodes;
+    top->getAllUpstreamNodes(nodes);
+
+    EXPECT_EQ(nodes.size(), 3 * numLevels + 1);
+    EXPECT_EQ(std::set<NodeBase*>(nodes.begin(), nodes.end()).size(), nodes.size());
+    EXPECT_EQ(nodes.front()->getID(), readNode1->getID());
+    EXPECT_EQ(nodes.back()->getID(), top->getID());
+
+    // Connecting a new input has to invalidate the memoized order
+    auto merge = new NodeBase(NODE_TYPE_MERGE, nodeGraph);
+    latticeNodes.push_back(merge);
+    connectNodes(top, merge->getRgbaBackIn());
+
+    nodes.clear();
+    merge->getAllUpstreamNodes(nodes);
+    EXPECT_EQ(nodes.size(), 3 * numLevels + 2);
+
+    connectNodes(readNode2, merge->getRgbaFrontIn());
+
+    nodes.clear();
+    merge->getAllUpstreamNodes(nodes);
+    EXPECT_EQ(nodes.size(), 3 * numLevels + 3);
+
+    // Disconnect from the top so no node has a large downstream graph left
+    for (auto it = connections.rbegin(); it != connections.rend(); ++it)
+    {
+        (*it)->sourceOutput->removeConnection(*it);
+        (*it)->targetInput->removeInConnection();
+    }
+    foreach(auto n, latticeNodes)
+    {
+        delete n;
+    }
+}
+
 TEST_F(NodeBaseTest, getAllDownstreamNodes_CorrectNumberOfNodes)
 {
     std::vector<NodeBase*> nodes;
@@ -148,4 +246,77 @@ TEST_F(NodeBaseTest, invalidateAllDownstreamNodes_AllInvalidated)
 
 }
 
+TEST_F(NodeBaseTest, invalidateAllDownstreamNodes_DeepGraphBenchmark)
+{
+    /*
+     * 200 Merge nodes, each one reading the previous node through
+     * both of its inputs, so the number of paths from Read1 to the
+     * last node doubles with every level
+    */
+
+    const int depth = 200;
+
+    std::vector<NodeBase*> deepNodes;
+    NodeBase* previous = readNode1;
+
+    for (int i = 0; i < depth; ++i)
+    {
+        auto merge = new NodeBase(NODE_TYPE_MERGE, nodeGraph);
+
+        connections.push_back(nodeGraph->createOpenConnection(previous->getRgbaOut()));
+        nodeGraph->establishConnection(merge->getRgbaBackIn());
+        connections.push_back(nodeGraph->createOpenConnection(previous->getRgbaOut()));
+        nodeGraph->establishConnection(merge->getRgbaFrontIn());
+
+        deepNodes.push_back(merge);
+        previous = merge;
+    }
+
+    int numRequests = 0;
+    auto countRequests = [&numRequests]() { numRequests++; };
+    // Every downstream node is reached once, no matter how many paths lead to it
+    int numInvalidations = 0;
+    auto countInvalidations = [&numInvalidations]() { numInvalidations++; };
+
+    std::vector<NodeBase*> watchedNodes = { readNode1, colorNode, mergeNode, writeNode };
+    watchedNodes.insert(watchedNodes.end(), deepNodes.begin(), deepNodes.end());
+
+    foreach(auto n, watchedNodes)
+    {
+        n->needsUpdate = false;
+        QObject::connect(n, &NodeBase::nodeRequestUpdate, countRequests);
+        QObject::connect(n, &NodeBase::nodeInvalidated, countInvalidations);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    readNode1->requestUpdate();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start);
+    RecordProperty("InvalidationMicroseconds", static_cast<int>(duration.count()));
+
+    EXPECT_EQ(numRequests, 1);
+    EXPECT_EQ(numInvalidations, depth + 3);
+
+    foreach(auto n, deepNodes)
+    {
+        EXPECT_EQ(n->needsUpdate, true);
+    }
+
+    std::vector<NodeBase*> nodes;
+    readNode1->getAllDownstreamNodes(nodes);
+    EXPECT_EQ(nodes.size(), depth + 3);
+
+    for (auto it = connections.rbegin(); it != connections.rend(); ++it)
+    {
+        (*it)->sourceOutput->removeConnection(*it);
+        (*it)->targetInput->removeInConnection();
+    }
+    foreach(auto n, deepNodes)
+    {
+        delete n;
+    }
+}
+
 #endif // TST_NODEBASETESTS_H
@@ -0,0 +1,140 @@
+#ifndef TST_NODEGRAPHTESTS_H
+#define TST_NODEGRAPHTESTS_H
+
+#include <chrono>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QUuid>
+
+#include <gtest/gtest.h>
+
+#include "../../src/nodebase.h"
+#include "../../src/nodegraph.h"
+#include "../../src/nodeinput.h"
+#include "../../src/nodedefinitions.h"
+
+using namespace testing;
+
+class NodeGraphTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        nodeGraph = new NodeGraph(nullptr);
+    }
+
+    void TearDown() override
+    {
+        nodeGraph->clear();
+        delete nodeGraph;
+    }
+
+    /*
+     * | Read | --- | Color | --- | Invert | --- | Color | --- ...
+     *
+     * Properties and inputs are taken from nodes
+     * of the same type, so they load like saved ones
+    */
+    QJsonArray createChainProject(const size_t numNodes)
+    {
+        const std::vector<NodeType> types = { NODE_TYPE_COLOR, NODE_TYPE_INVERT };
+
+        std::map<NodeType, QJsonObject> templates;
+        for (auto type : { NODE_TYPE_READ, NODE_TYPE_COLOR, NODE_TYPE_INVERT })
+        {
+            NodeBase node(type, nodeGraph);
+            QJsonArray array;
+            node.addNodeToJsonArray(array);
+            templates[type] = array.at(0).toObject();
+        }
+
+        QJsonArray jsonNodesArray;
+        QJsonArray jsonConnectionsArray;
+        QString previousID;
+
+        for (size_t i = 0; i < numNodes; ++i)
+        {
+            NodeType type = i == 0 ? NODE_TYPE_READ : types[i % types.size()];
+            QJsonObject jsonNode = templates[type];
+
+            QString id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+            jsonNode["uuid"] = id;
+            jsonNode["posx"] = static_cast<int>(1000 + 150 * (i % 200));
+            jsonNode["posy"] = static_cast<int>(1000 + 150 * (i / 200));
+
+            QJsonObject jsonInputs = jsonNode["inputs"].toObject();
+            for (auto it = jsonInputs.begin(); it != jsonInputs.end(); ++it)
+                it.value() = QUuid::createUuid().toString(QUuid::WithoutBraces);
+            jsonNode["inputs"] = jsonInputs;
+
+            if (!previousID.isEmpty())
+            {
+                QJsonObject jsonConnection {
+                    { "src", previousID },
+                    { "dst-node", id },
+                    { "dst", jsonInputs.value("0").toString() }
+                };
+                jsonConnectionsArray.push_back(jsonConnection);
+            }
+
+            jsonNodesArray.push_back(jsonNode);
+            previousID = id;
+        }
+
+        QJsonArray jsonNodeGraph;
+        jsonNodeGraph.push_back(QJsonObject { { "nodes", jsonNodesArray } });
+        jsonNodeGraph.push_back(QJsonObject { { "connections", jsonConnectionsArray } });
+
+        return jsonNodeGraph;
+    }
+
+    void loadProject(const QJsonArray& jsonNodeGraph)
+    {
+        nodeGraph->loadProject(jsonNodeGraph);
+    }
+
+    NodeGraph* nodeGraph;
+};
+
+TEST_F(NodeGraphTest, loadProject_GeneratedProjectBenchmark)
+{
+    const size_t numNodes = 5000;
+
+    auto jsonNodeGraph = createChainProject(numNodes);
+
+    auto start = std::chrono::steady_clock::now();
+
+    loadProject(jsonNodeGraph);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+    RecordProperty("LoadMilliseconds", static_cast<int>(duration.count()));
+
+    EXPECT_EQ(nodeGraph->getNodes().size(), numNodes);
+
+    // Every connection was resolved
+    auto last = nodeGraph->getNodes().back();
+    std::vector<NodeBase*> nodes;
+    last->getAllUpstreamNodes(nodes);
+    EXPECT_EQ(nodes.size(), numNodes);
+    EXPECT_EQ(nodes.front()->nodeType, NODE_TYPE_READ);
+
+    // Nodes that were never opened are saved as they were loaded
+    QJsonArray savedNodeGraph;
+    nodeGraph->getNodeGraphAsJson(savedNodeGraph);
+    EXPECT_EQ(savedNodeGraph, jsonNodeGraph);
+
+    // Loading again replaces the whole graph
+    start = std::chrono::steady_clock::now();
+
+    loadProject(jsonNodeGraph);
+
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+    RecordProperty("ReloadMilliseconds", static_cast<int>(duration.count()));
+
+    EXPECT_EQ(nodeGraph->getNodes().size(), numNodes);
+}
+
+#endif // TST_NODEGRAPHTESTS_H